@@ -0,0 +1,177 @@
+#include <algorithm>
+#include <fstream>
+
+#include "utils.h"
+#include "animation.h"
+
+using Eigen::AngleAxisd;
+using Eigen::Quaterniond;
+using Eigen::Vector3d;
+
+/* Orders keyframes of either kind by frame */
+template <typename Key>
+static bool keyBefore(const Key &a, const Key &b) {
+    return a.frame < b.frame;
+}
+
+/*
+ Finds the keyframes around frame and how far frame is between them.
+ Returns the index of the earlier key and sets t in [0, 1], with both
+ keys the same at and beyond the ends.
+*/
+template <typename Key>
+static size_t bracket(const vector<Key> &keys, int frame, size_t &next, double &t) {
+    size_t i = 0;
+    while (i + 1 < keys.size() && keys[i + 1].frame <= frame) {
+        i++;
+    }
+    next = (i + 1 < keys.size() && keys[i].frame <= frame) ? i + 1 : i;
+    if (next == i) {
+        t = 0;
+    } else {
+        t = (frame - keys[i].frame) * 1.0 / (keys[next].frame - keys[i].frame);
+    }
+    return i;
+}
+
+static vertex_t lerp(vertex_t a, vertex_t b, double t) {
+    return initVertex(a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t, a.z + (b.z - a.z) * t);
+}
+
+static Quaterniond toQuaternion(vertex_t axis, double angle) {
+    Vector3d v(axis.x, axis.y, axis.z);
+    if (v.norm() == 0) {
+        return Quaterniond::Identity();
+    }
+    return Quaterniond(AngleAxisd(angle, v.normalized()));
+}
+
+void Animation::processFile(string filename) {
+    string buffer;
+    ifstream file;
+    file.open(filename.c_str(), ifstream::in);
+    if (file.fail()) {
+        throw invalid_argument("Could not read animation file '" + filename + "'.");
+    }
+
+    frames = 0;
+    camera_keys.clear();
+    instance_keys.clear();
+
+    vector<string> line;
+    /* Block being read: "" between blocks, "camera" or a copy name */
+    string block = "";
+    camera_key_t cam_key;
+    instance_key_t inst_key;
+    auto finishBlock = [&]() {
+        if (block == "camera") {
+            camera_keys.push_back(cam_key);
+        } else if (!block.empty()) {
+            instance_keys[block].push_back(inst_key);
+        }
+        block = "";
+    };
+
+    try {
+        while (getline(file, buffer)) {
+            line.clear();
+            splitBySpace(buffer, line);
+
+            if (line.size() == 0) {
+                finishBlock();
+                continue;
+            }
+
+            if (block.empty()) {
+                if (line[0] == "frames") {
+                    frames = stoi(line.at(1));
+                    /* Reported below as a parse error */
+                    if (frames <= 0) {
+                        throw out_of_range("frames");
+                    }
+                    continue;
+                }
+                block = line[0];
+                int frame = stoi(line.at(1));
+                if (block == "camera") {
+                    cam_key.frame = frame;
+                    cam_key.pos = initVertex(0, 0, 0);
+                    cam_key.orien = initVertex(0, 1, 0);
+                    cam_key.angle = 0;
+                } else {
+                    inst_key.frame = frame;
+                    inst_key.translate = initVertex(0, 0, 0);
+                    inst_key.rot_axis = initVertex(0, 1, 0);
+                    inst_key.rot_angle = 0;
+                    inst_key.scale = initVertex(1, 1, 1);
+                }
+                continue;
+            }
+
+            vertex_t v = initVertex(stod(line.at(1)), stod(line.at(2)), stod(line.at(3)));
+            if (block == "camera") {
+                if (line[0] == "position") {
+                    cam_key.pos = v;
+                } else if (line[0] == "orientation") {
+                    cam_key.orien = v;
+                    cam_key.angle = stod(line.at(4));
+                }
+            } else if (line[0][0] == 't') {
+                inst_key.translate = v;
+            } else if (line[0][0] == 'r') {
+                inst_key.rot_axis = v;
+                inst_key.rot_angle = stod(line.at(4));
+            } else {
+                inst_key.scale = v;
+            }
+        }
+        finishBlock();
+    } catch (const logic_error &e) {
+        throw invalid_argument("Could not parse animation file '" + filename + "'.");
+    }
+    file.close();
+
+    if (frames <= 0) {
+        throw invalid_argument("Animation file '" + filename + "' needs a positive frame count.");
+    }
+    stable_sort(camera_keys.begin(), camera_keys.end(), keyBefore<camera_key_t>);
+    for (auto &keys : instance_keys) {
+        stable_sort(keys.second.begin(), keys.second.end(), keyBefore<instance_key_t>);
+    }
+}
+
+void Animation::cameraAt(int frame, vertex_t &pos, vertex_t &orien, double &angle) {
+    if (camera_keys.empty()) {
+        return;
+    }
+    size_t next;
+    double t;
+    size_t i = bracket(camera_keys, frame, next, t);
+    const camera_key_t &a = camera_keys[i], &b = camera_keys[next];
+
+    pos = lerp(a.pos, b.pos, t);
+    AngleAxisd rot(toQuaternion(a.orien, a.angle).slerp(t, toQuaternion(b.orien, b.angle)));
+    orien = initVertex(rot.axis()[0], rot.axis()[1], rot.axis()[2]);
+    angle = rot.angle();
+}
+
+Matrix4d Animation::instanceAt(const string &name, int frame) {
+    map<string, vector<instance_key_t>>::iterator found = instance_keys.find(name);
+    if (found == instance_keys.end() || found->second.empty()) {
+        return Matrix4d::Identity();
+    }
+    const vector<instance_key_t> &keys = found->second;
+    size_t next;
+    double t;
+    size_t i = bracket(keys, frame, next, t);
+    const instance_key_t &a = keys[i], &b = keys[next];
+
+    vertex_t tr = lerp(a.translate, b.translate, t);
+    vertex_t sc = lerp(a.scale, b.scale, t);
+    AngleAxisd rot(toQuaternion(a.rot_axis, a.rot_angle).slerp(t,
+                   toQuaternion(b.rot_axis, b.rot_angle)));
+
+    return translation(tr.x, tr.y, tr.z) *
+           rotation(rot.axis()[0], rot.axis()[1], rot.axis()[2], rot.angle()) *
+           scaling(sc.x, sc.y, sc.z);
+}
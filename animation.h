@@ -0,0 +1,69 @@
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include "object.h"
+#include "transformation.h"
+
+using namespace std;
+
+/* Camera position and orientation at a keyframe */
+typedef struct cameraKey {
+    int frame;
+    vertex_t pos;
+    vertex_t orien;
+    double angle;
+} camera_key_t;
+
+/* Extra transform of an object copy at a keyframe, applied on top of the
+   scene's transform as scale, then rotation, then translation */
+typedef struct instanceKey {
+    int frame;
+    vertex_t translate;
+    vertex_t rot_axis;
+    double rot_angle;
+    vertex_t scale;
+} instance_key_t;
+
+/**
+ * Keyframed camera and object copy motion for rendering a scene as a
+ * sequence of frames. Between keyframes positions, translations and scales
+ * are interpolated linearly and orientations by quaternion slerp; before
+ * the first and after the last keyframe the nearest one holds.
+ */
+class Animation {
+    public:
+        int frames;
+        /* Sorted by frame; empty if the scene's camera never moves */
+        vector<camera_key_t> camera_keys;
+        /* Sorted by frame, mapped by the name of the copy they move */
+        map<string, vector<instance_key_t>> instance_keys;
+
+        /**
+         * Populates Animation from an animation .txt file made of a
+         * "frames N" line and blocks separated by blank lines. Each block
+         * starts with "camera F" followed by position and orientation lines
+         * as in the scene format, or "copy_name F" followed by at most one
+         * each of t, r and s lines.
+         *
+         * @param filename of the .txt file to be processed
+         * @throws invalid_argument if it fails to read or parse the file
+         */
+        void processFile(string filename);
+
+        /**
+         * Sets pos, orien and angle to the camera at frame.
+         * Leaves them untouched if there are no camera keyframes.
+         */
+        void cameraAt(int frame, vertex_t &pos, vertex_t &orien, double &angle);
+
+        /**
+         * Returns the extra transform of the copy named name at frame,
+         * the identity if it has no keyframes.
+         */
+        Matrix4d instanceAt(const string &name, int frame);
+};
+
+#endif
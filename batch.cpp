@@ -0,0 +1,135 @@
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+
+#include "utils.h"
+#include "batch.h"
+
+void readBatchFile(string filename, vector<batch_job_t> &jobs) {
+    string buffer;
+    ifstream file;
+    file.open(filename.c_str(), ifstream::in);
+    if (file.fail()) {
+        throw invalid_argument("Could not read batch file '" + filename + "'.");
+    }
+
+    vector<string> line;
+    while (getline(file, buffer)) {
+        line.clear();
+        splitBySpace(buffer, line);
+        if (line.size() == 0) {
+            continue;
+        }
+
+        batch_job_t job;
+        try {
+            job.scene = line.at(0);
+            job.xres = stoi(line.at(1));
+            job.yres = stoi(line.at(2));
+        } catch (const logic_error &e) {
+            throw invalid_argument("Could not parse batch file '" + filename + "'.");
+        }
+        if (job.xres <= 0 || job.yres <= 0) {
+            throw invalid_argument("Batch file '" + filename +
+                                   "' needs positive resolutions.");
+        }
+        jobs.push_back(job);
+    }
+    file.close();
+
+    /* Jobs writing the same PPM, as named by Wireframe::processFormatFile,
+       would write it at the same time, so each is told apart by its
+       resolution; the same scene twice at one resolution is an error */
+    map<string, vector<batch_job_t *>> outputs;
+    for (batch_job_t &job : jobs) {
+        error_code ec;
+        string base = job.scene.substr(0, job.scene.find('.'));
+        filesystem::path resolved = filesystem::weakly_canonical(base, ec);
+        outputs[ec ? base : resolved.string()].push_back(&job);
+    }
+    for (map<string, vector<batch_job_t *>>::iterator iter = outputs.begin();
+            iter != outputs.end(); iter++) {
+        if (iter->second.size() < 2) {
+            continue;
+        }
+        map<pair<int, int>, int> resolutions;
+        for (batch_job_t *job : iter->second) {
+            if (resolutions[{job->xres, job->yres}]++ > 0) {
+                throw invalid_argument("Batch file '" + filename + "' lists " + job->scene + 
+                                       " twice at " + to_string(job->xres) + " x " + 
+                                       to_string(job->yres) + ".");
+            }
+            job->output_suffix = "_" + to_string(job->xres) + "x" + to_string(job->yres);
+        }
+    }
+}
+
+/* Renders job the way main renders a single scene, without standard out */
+static void renderJob(const batch_job_t &job, const Wireframe &settings,
+                      MeshCache &cache, RenderStats &job_stats) {
+    Wireframe pipeline = settings;
+    pipeline.xres = job.xres;
+    pipeline.yres = job.yres;
+    pipeline.mesh_cache = &cache;
+    pipeline.output_suffix = job.output_suffix;
+
+    pipeline.processFormatFile(job.scene);
+    pipeline.computeTransforms();
+    pipeline.applyTransforms();
+    if (pipeline.band_rows > 0) {
+        pipeline.renderBanded(true, false);
+    } else {
+        pipeline.plot(true);
+        pipeline.output(false);
+    }
+    pipeline.destruct();
+    job_stats = pipeline.stats;
+}
+
+int renderBatch(const vector<batch_job_t> &jobs, const Wireframe &settings,
+                MeshCache &cache, RenderStats &stats) {
+    Stopwatch watch;
+    int failed = 0;
+    mutex report_lock;
+
+    TaskGroup group(settings.scheduler);
+    for (size_t i = 0; i < jobs.size(); i++) {
+        group.run([&, i]() {
+            RenderStats job_stats;
+            string error;
+            try {
+                renderJob(jobs[i], settings, cache, job_stats);
+            } catch (const char *msg) {
+                error = msg;
+            } catch (const exception &e) {
+                error = e.what();
+            }
+
+            lock_guard<mutex> guard(report_lock);
+            if (!error.empty()) {
+                cerr << jobs[i].scene << ": " << error << endl;
+                failed++;
+                return;
+            }
+            for (size_t t = 0; t < job_stats.times.size(); t++) {
+                stats.addTime(job_stats.times[t].first, job_stats.times[t].second);
+            }
+        });
+    }
+    group.wait();
+
+    if (stats.enabled) {
+        stats.addTime("batch", watch.elapsedMs());
+        stats.addCount("jobs", jobs.size());
+        stats.addCount("failed jobs", failed);
+        stats.addCount("worker threads", 
+                       settings.scheduler ? settings.scheduler->threads() : 1);
+        stats.addCount("mesh cache hits", cache.hits);
+        stats.addCount("mesh cache misses", cache.misses);
+        stats.addCount("mesh cache evictions", cache.evictions);
+        stats.addCount("mesh cache bytes", cache.resident_bytes);
+    }
+    return failed;
+}
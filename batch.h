@@ -0,0 +1,46 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <string>
+#include <vector>
+#include "wireframe.h"
+#include "meshcache.h"
+#include "stats.h"
+
+using namespace std;
+
+/* One scene to render and its resolution */
+typedef struct batchJob {
+    string scene;
+    int xres;
+    int yres;
+    /* Appended to the PPM's name when other jobs render the same scene */
+    string output_suffix;
+} batch_job_t;
+
+/**
+ * Reads a batch list file, one "scene_description_file.txt xres yres"
+ * per line. Blank lines are skipped. A scene listed more than once is
+ * written to scene_XRESxYRES.ppm for each of its resolutions.
+ *
+ * @throws invalid_argument if it fails to read or parse the file
+ */
+void readBatchFile(string filename, vector<batch_job_t> &jobs);
+
+/**
+ * Renders every job to its scene's PPM file, each job a task on
+ * settings.scheduler (or one after another if it is null) whose stages
+ * submit their own work to the same pool. Every job runs in its own
+ * Wireframe copied from settings, so they share the rendering options
+ * but not state, except for meshes, which all come from cache.
+ * Nothing is printed to standard out; a job that fails has its error
+ * printed to standard error and doesn't stop the others.
+ *
+ * Stage times of all jobs are summed into stats if stats.enabled.
+ *
+ * @returns the number of jobs that failed
+ */
+int renderBatch(const vector<batch_job_t> &jobs, const Wireframe &settings,
+                MeshCache &cache, RenderStats &stats);
+
+#endif
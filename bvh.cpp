@@ -0,0 +1,213 @@
+#include <algorithm>
+#include <functional>
+#include <numeric>
+
+#include "bvh.h"
+
+/* Instances above which a subtree is built by a task of its own */
+static const uint32_t PARALLEL_BUILD_ITEMS = 4096;
+
+box_t sphereBox(vertex_t center, double r) {
+    box_t b;
+    b.lo = initVertex(center.x - r, center.y - r, center.z - r);
+    b.hi = initVertex(center.x + r, center.y + r, center.z + r);
+    return b;
+}
+
+static box_t unite(const box_t &a, const box_t &b) {
+    box_t u;
+    u.lo = initVertex(min(a.lo.x, b.lo.x), min(a.lo.y, b.lo.y), min(a.lo.z, b.lo.z));
+    u.hi = initVertex(max(a.hi.x, b.hi.x), max(a.hi.y, b.hi.y), max(a.hi.z, b.hi.z));
+    return u;
+}
+
+static double surfaceArea(const box_t &b) {
+    double dx = b.hi.x - b.lo.x, dy = b.hi.y - b.lo.y, dz = b.hi.z - b.lo.z;
+    return 2 * (dx * dy + dy * dz + dz * dx);
+}
+
+/* Least and greatest of plane over the box */
+static void planeRange(const double plane[4], const box_t &b, double &least, double &most) {
+    least = most = plane[3];
+    double lo[3] = {b.lo.x, b.lo.y, b.lo.z}, hi[3] = {b.hi.x, b.hi.y, b.hi.z};
+    for (int k = 0; k < 3; k++) {
+        least += plane[k] * ((plane[k] > 0) ? lo[k] : hi[k]);
+        most += plane[k] * ((plane[k] > 0) ? hi[k] : lo[k]);
+    }
+}
+
+uint32_t InstanceBvh::countNodes(uint32_t count) {
+    map<uint32_t, uint32_t>::iterator found = subtree_nodes.find(count);
+    if (found != subtree_nodes.end()) {
+        return found->second;
+    }
+    uint32_t total = 1;
+    if (count > (uint32_t) BVH_LEAF_SIZE) {
+        total += countNodes(count / 2) + countNodes(count - count / 2);
+    }
+    subtree_nodes[count] = total;
+    return total;
+}
+
+void InstanceBvh::build(const vector<box_t> &bounds, Scheduler *scheduler) {
+    uint32_t n = bounds.size();
+    items.resize(n);
+    iota(items.begin(), items.end(), 0);
+    subtree_nodes.clear();
+    nodes.assign((n == 0) ? 0 : countNodes(n), node_t());
+    parents.assign(nodes.size(), 0);
+    leaves.assign(n, 0);
+    stale.assign(nodes.size(), false);
+    if (n > 0) {
+        buildNode(0, 0, n, bounds, scheduler);
+    }
+
+    area = 0;
+    for (const node_t &node : nodes) {
+        area += surfaceArea(node.bounds);
+    }
+    built_area = area;
+}
+
+void InstanceBvh::buildNode(size_t index, uint32_t begin, uint32_t end,
+                            const vector<box_t> &bounds, Scheduler *scheduler) {
+    node_t &node = nodes[index];
+    node.bounds = bounds[items[begin]];
+    box_t centers = sphereBox(initVertex(0, 0, 0), 0);
+    for (uint32_t i = begin; i < end; i++) {
+        const box_t &b = bounds[items[i]];
+        vertex_t c = initVertex((b.lo.x + b.hi.x) / 2, (b.lo.y + b.hi.y) / 2,
+                                (b.lo.z + b.hi.z) / 2);
+        node.bounds = unite(node.bounds, b);
+        centers = (i == begin) ? sphereBox(c, 0) : unite(centers, sphereBox(c, 0));
+    }
+    uint32_t count = end - begin;
+    if (count <= (uint32_t) BVH_LEAF_SIZE) {
+        node.first = begin;
+        node.count = count;
+        for (uint32_t i = begin; i < end; i++) {
+            leaves[items[i]] = index;
+        }
+        return;
+    }
+
+    /* Splits at the median of the centers along their widest axis */
+    double extent[3] = {centers.hi.x - centers.lo.x, centers.hi.y - centers.lo.y,
+                        centers.hi.z - centers.lo.z};
+    int axis = max_element(extent, extent + 3) - extent;
+    auto center = [&](uint32_t item) {
+        const box_t &b = bounds[item];
+        return (axis == 0) ? b.lo.x + b.hi.x : (axis == 1) ? b.lo.y + b.hi.y : b.lo.z + b.hi.z;
+    };
+    uint32_t mid = begin + count / 2;
+    nth_element(items.begin() + begin, items.begin() + mid, items.begin() + end,
+                [&](uint32_t a, uint32_t b) {
+                    return center(a) < center(b) || (center(a) == center(b) && a < b);
+                });
+
+    size_t left = index + 1;
+    size_t right = left + subtree_nodes.at(count / 2);
+    node.first = right;
+    node.count = 0;
+    parents[left] = parents[right] = index;
+    if (count > PARALLEL_BUILD_ITEMS && scheduler != nullptr) {
+        /* A group per split, as a TaskGroup takes tasks from one thread */
+        TaskGroup tasks(scheduler);
+        tasks.run([=, &bounds]() { buildNode(left, begin, mid, bounds, scheduler); });
+        buildNode(right, mid, end, bounds, scheduler);
+        tasks.wait();
+    } else {
+        buildNode(left, begin, mid, bounds, scheduler);
+        buildNode(right, mid, end, bounds, scheduler);
+    }
+}
+
+void InstanceBvh::refit(const vector<box_t> &bounds, const vector<uint32_t> &changed) {
+    /* Gathers the leaves of the changed instances and their ancestors,
+       climbing from each leaf until a node already gathered */
+    vector<uint32_t> due;
+    for (uint32_t item : changed) {
+        for (uint32_t index = leaves[item]; !stale[index]; index = parents[index]) {
+            stale[index] = true;
+            due.push_back(index);
+            if (index == 0) {
+                break;
+            }
+        }
+    }
+
+    /* Children follow their parents, so a backwards pass sees them first */
+    sort(due.begin(), due.end(), greater<uint32_t>());
+    for (uint32_t index : due) {
+        area -= surfaceArea(nodes[index].bounds);
+        fitNode(index, bounds);
+        area += surfaceArea(nodes[index].bounds);
+        stale[index] = false;
+    }
+}
+
+void InstanceBvh::fitNode(size_t index, const vector<box_t> &bounds) {
+    node_t &node = nodes[index];
+    if (node.count > 0) {
+        node.bounds = bounds[items[node.first]];
+        for (uint32_t k = 1; k < node.count; k++) {
+            node.bounds = unite(node.bounds, bounds[items[node.first + k]]);
+        }
+    } else {
+        node.bounds = unite(nodes[index + 1].bounds, nodes[node.first].bounds);
+    }
+}
+
+size_t InstanceBvh::size() const {
+    return items.size();
+}
+
+size_t InstanceBvh::nodeCount() const {
+    return nodes.size();
+}
+
+size_t InstanceBvh::query(const frustum_t &view, vector<uint32_t> &visible) const {
+    if (nodes.empty()) {
+        return 0;
+    }
+    size_t visited = 0;
+    /* Nodes to visit, each flagged if wholly in view */
+    vector<pair<uint32_t, bool>> stack = {{0, false}};
+    while (!stack.empty()) {
+        uint32_t index = stack.back().first;
+        bool inside = stack.back().second;
+        stack.pop_back();
+        const node_t &node = nodes[index];
+        visited++;
+
+        if (!inside) {
+            double least, most;
+            planeRange(view.front, node.bounds, least, most);
+            if (most <= 0) {
+                continue;
+            }
+            inside = least > 0;
+            if (least > 0) {
+                for (int s = 0; s < 4; s++) {
+                    planeRange(view.sides[s], node.bounds, least, most);
+                    if (most < 0) {
+                        break;
+                    }
+                    inside &= least >= 0;
+                }
+                if (most < 0) {
+                    continue;
+                }
+            }
+        }
+
+        if (node.count > 0) {
+            visible.insert(visible.end(), items.begin() + node.first,
+                           items.begin() + node.first + node.count);
+        } else {
+            stack.push_back({node.first, inside});
+            stack.push_back({index + 1, inside});
+        }
+    }
+    return visited;
+}
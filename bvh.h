@@ -0,0 +1,115 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <vector>
+#include "object.h"
+#include "scheduler.h"
+
+using namespace std;
+
+/* Most instances a leaf of an InstanceBvh holds */
+const int BVH_LEAF_SIZE = 4;
+
+/* Axis-aligned box */
+typedef struct box {
+    vertex_t lo;
+    vertex_t hi;
+} box_t;
+
+/* Box around the sphere of radius r at center */
+box_t sphereBox(vertex_t center, double r);
+
+/* Region of space that can land on the Pixel Grid, as planes
+   a x + b y + c z + d >= 0 */
+typedef struct frustum {
+    /* Left, right, bottom and top sides, which only bound points in
+       front of the eye: perspective maps points behind it mirrored */
+    double sides[4][4];
+    /* In front of the eye */
+    double front[4];
+} frustum_t;
+
+/**
+ * Bounding volume hierarchy over the boxes of a scene's instances, for
+ * finding those that can be seen without testing each one.
+ *
+ * Nodes are kept in one array in depth-first order: a node's left child
+ * follows it and its right child follows the left's subtree. Splits are
+ * at the median along the widest axis of the box centers, so the shape of
+ * the tree only depends on the number of instances and the layout can be
+ * worked out up front, letting subtrees be built by separate tasks.
+ */
+class InstanceBvh {
+    public:
+        /* Sum of node box areas when last built, and now */
+        double built_area = 0, area = 0;
+
+        /**
+         * Builds the tree over bounds, one box per instance, with a task
+         * per large subtree on scheduler (nullptr builds serially).
+         */
+        void build(const vector<box_t> &bounds, Scheduler *scheduler);
+
+        /**
+         * Recomputes, keeping the tree's shape, the boxes of the leaves
+         * holding the changed instances and of the nodes above them from
+         * bounds, which holds as many instances as the last build.
+         * Takes time in the number changed, not the size of the tree.
+         */
+        void refit(const vector<box_t> &bounds, const vector<uint32_t> &changed);
+
+        /**
+         * Number of instances the tree was built over.
+         */
+        size_t size() const;
+
+        /**
+         * Number of nodes in the tree.
+         */
+        size_t nodeCount() const;
+
+        /**
+         * Appends to visible the indexes of the instances whose box may
+         * lie in view, unordered, skipping the subtrees wholly out of view
+         * and testing none below one wholly in view. Returns the number of
+         * nodes visited.
+         */
+        size_t query(const frustum_t &view, vector<uint32_t> &visible) const;
+
+    private:
+        typedef struct node {
+            box_t bounds;
+            /* Leaf: instances items[first, first + count). Inner node:
+               count is 0 and first indexes its right child */
+            uint32_t first;
+            uint32_t count;
+        } node_t;
+
+        vector<node_t> nodes;
+        /* Parent of each node, and the leaf holding each instance */
+        vector<uint32_t> parents;
+        vector<uint32_t> leaves;
+        /* Nodes already due a refit, so shared ancestors are refit once */
+        vector<bool> stale;
+        /* Instance indexes, grouped by leaf */
+        vector<uint32_t> items;
+        /* Nodes in the subtree over each number of instances being built */
+        map<uint32_t, uint32_t> subtree_nodes;
+
+        /**
+         * Fills subtree_nodes for count instances and those below them,
+         * returning the entry for count.
+         */
+        uint32_t countNodes(uint32_t count);
+
+        void buildNode(size_t index, uint32_t begin, uint32_t end,
+                       const vector<box_t> &bounds, Scheduler *scheduler);
+
+        /* Sets the box of node index from its instances or children */
+        void fitNode(size_t index, const vector<box_t> &bounds);
+};
+
+#endif
@@ -0,0 +1,141 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "depthbuffer.h"
+
+static const float FAR = numeric_limits<float>::infinity();
+
+void DepthBuffer::resize(int width, int height) {
+    this->width = width;
+    this->height = height;
+    tiles_x = (width + FB_TILE - 1) / FB_TILE;
+    size_t num_tiles = (size_t) tiles_x * ((height + FB_TILE - 1) / FB_TILE);
+    depths.resize(num_tiles * FB_TILE * FB_TILE);
+    tile_near.resize(num_tiles);
+    tile_far.resize(num_tiles);
+}
+
+void DepthBuffer::clearRows(int row0, int row_end) {
+    for (int y = row0; y < row_end; y++) {
+        for (int tx = 0; tx < tiles_x; tx++) {
+            float *row = &depths[(size_t) (y / FB_TILE * tiles_x + tx) * (FB_TILE * FB_TILE) +
+                                 (y % FB_TILE) * FB_TILE];
+            fill(row, row + FB_TILE, FAR);
+        }
+    }
+}
+
+void DepthBuffer::addTriangle(grid_vertex_t a, float za, grid_vertex_t b, float zb,
+                              grid_vertex_t c, float zc, int row0, int row_end,
+                              float slope_offset) {
+    long long area = (long long) (b.x - a.x) * (c.y - a.y) - (long long) (c.x - a.x) * (b.y - a.y);
+    if (area == 0) {
+        return;
+    }
+    /* Orders the vertexes so points inside are on the left of every edge */
+    if (area < 0) {
+        swap(b, c);
+        swap(zb, zc);
+        area = -area;
+    }
+
+    /* Depth is affine in screen space, so the triangle is a plane */
+    double dz_dx = ((double) (zb - za) * (c.y - a.y) - (double) (zc - za) * (b.y - a.y)) / area;
+    double dz_dy = ((double) (zc - za) * (b.x - a.x) - (double) (zb - za) * (c.x - a.x)) / area;
+    double offset = slope_offset * max(fabs(dz_dx), fabs(dz_dy));
+
+    int x_min = max(0, min(a.x, min(b.x, c.x)));
+    int x_max = min(width - 1, max(a.x, max(b.x, c.x)));
+    int y_min = max(row0, min(a.y, min(b.y, c.y)));
+    int y_max = min(row_end - 1, max(a.y, max(b.y, c.y)));
+
+    /* Edge functions, each >= 0 on the inside of its edge */
+    auto edge = [](grid_vertex_t p, grid_vertex_t q, long long x, long long y) {
+        return (q.x - p.x) * (y - p.y) - (q.y - p.y) * (x - p.x);
+    };
+    for (int y = y_min; y <= y_max; y++) {
+        long long w0 = edge(b, c, x_min, y), w1 = edge(c, a, x_min, y), w2 = edge(a, b, x_min, y);
+        long long step0 = -(c.y - b.y), step1 = -(a.y - c.y), step2 = -(b.y - a.y);
+        double z = za + dz_dx * (x_min - a.x) + dz_dy * (y - a.y) + offset;
+        for (int x = x_min; x <= x_max; x++) {
+            if ((w0 | w1 | w2) >= 0) {
+                float &cell = depths[(size_t) (y / FB_TILE * tiles_x + x / FB_TILE) *
+                                     (FB_TILE * FB_TILE) + (y % FB_TILE) * FB_TILE + x % FB_TILE];
+                cell = min(cell, (float) z);
+            }
+            w0 += step0;
+            w1 += step1;
+            w2 += step2;
+            z += dz_dx;
+        }
+    }
+}
+
+void DepthBuffer::updateTiles(int row0, int row_end) {
+    for (int ty = row0 / FB_TILE; ty * FB_TILE < row_end; ty++) {
+        for (int tx = 0; tx < tiles_x; tx++) {
+            float near = FAR, far = -FAR;
+            for (int y = ty * FB_TILE; y < min(height, (ty + 1) * FB_TILE); y++) {
+                for (int x = tx * FB_TILE; x < min(width, (tx + 1) * FB_TILE); x++) {
+                    near = min(near, at(y, x));
+                    far = max(far, at(y, x));
+                }
+            }
+            tile_near[(size_t) ty * tiles_x + tx] = near;
+            tile_far[(size_t) ty * tiles_x + tx] = far;
+        }
+    }
+}
+
+line_test_t DepthBuffer::clipLine(grid_vertex_t a, float za, grid_vertex_t b, float zb,
+                                  float bias, vector<grid_edge_t> &visible) const {
+    /* First compares the line against the depth range of its tiles */
+    float near = FAR, far = -FAR;
+    for (int ty = min(a.y, b.y) / FB_TILE; ty <= max(a.y, b.y) / FB_TILE; ty++) {
+        for (int tx = min(a.x, b.x) / FB_TILE; tx <= max(a.x, b.x) / FB_TILE; tx++) {
+            near = min(near, tile_near[(size_t) ty * tiles_x + tx]);
+            far = max(far, tile_far[(size_t) ty * tiles_x + tx]);
+        }
+    }
+    if (min(za, zb) > far + bias) {
+        return LINE_REJECTED;
+    }
+    if (max(za, zb) <= near + bias) {
+        visible.push_back(initGridEdge(a, b));
+        return LINE_ACCEPTED;
+    }
+
+    /* Then walks it, appending each run of visible points */
+    long long dx = (long long) b.x - a.x, dy = (long long) b.y - a.y;
+    long long n = max(llabs(dx), llabs(dy));
+    auto point = [&](long long i) {
+        if (n == 0) {
+            return a;
+        }
+        return initGridVertex(a.x + llround((double) i * dx / n),
+                              a.y + llround((double) i * dy / n));
+    };
+    long long run_start = -1;
+    for (long long i = 0; i <= n; i++) {
+        grid_vertex_t p = point(i);
+        float z = (n == 0) ? za : za + (zb - za) * (float) ((double) i / n);
+        bool shown = z <= at(p.y, p.x) + bias;
+        if (shown && run_start < 0) {
+            run_start = i;
+        } else if (!shown && run_start >= 0) {
+            visible.push_back(initGridEdge(point(run_start), point(i - 1)));
+            run_start = -1;
+        }
+    }
+    if (run_start == 0) {
+        visible.push_back(initGridEdge(a, b));
+    } else if (run_start > 0) {
+        visible.push_back(initGridEdge(point(run_start), b));
+    }
+    return LINE_WALKED;
+}
+
+size_t DepthBuffer::bytesAllocated() const {
+    return (depths.capacity() + tile_near.capacity() + tile_far.capacity()) * sizeof(float);
+}
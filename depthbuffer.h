@@ -0,0 +1,92 @@
+#ifndef DEPTHBUFFER_H
+#define DEPTHBUFFER_H
+
+#include <vector>
+#include "object.h"
+#include "framebuffer.h"
+
+using namespace std;
+
+/* How a line fared against a DepthBuffer's tiles */
+typedef enum lineTest {
+    /* Nearer than every tile it crosses: drawn whole */
+    LINE_ACCEPTED,
+    /* Farther than every tile it crosses: dropped */
+    LINE_REJECTED,
+    /* Tested pixel by pixel */
+    LINE_WALKED
+} line_test_t;
+
+/**
+ * Depth of the nearest face at each pixel of a grid, for hidden-line
+ * removal. Depths are NDC z, smaller is nearer, and pixels no face covers
+ * are infinitely far.
+ *
+ * Pixels are stored in the FB_TILE x FB_TILE tiles of the Framebuffer
+ * tiled layouts (row-major inside each tile), and each tile also keeps
+ * its nearest and farthest depth, so most lines are found wholly visible
+ * or wholly hidden without reading their pixels. Rows of tiles are
+ * independent: separate threads may fill separate rows of tiles.
+ */
+class DepthBuffer {
+    public:
+        int width = 0, height = 0;
+
+        /**
+         * Sizes the buffer to width by height, keeping its storage
+         * if it's big enough. Pixels are left as they were.
+         */
+        void resize(int width, int height);
+
+        /**
+         * Makes rows [row0, row_end) infinitely far.
+         */
+        void clearRows(int row0, int row_end);
+
+        /**
+         * Keeps, for each pixel in rows [row0, row_end) whose center lies in
+         * the triangle a, b, c, the nearer of its depth and the triangle's,
+         * interpolated from the depths za, zb, zc of its vertexes.
+         *
+         * The triangle is pushed back by slope_offset times its greatest
+         * change in depth per pixel, so the lines along its own edges,
+         * which pass up to half a pixel off the pixel centers, aren't
+         * hidden by it. Edge-on triangles are skipped.
+         */
+        void addTriangle(grid_vertex_t a, float za, grid_vertex_t b, float zb,
+                         grid_vertex_t c, float zc, int row0, int row_end,
+                         float slope_offset);
+
+        /**
+         * Recomputes the nearest and farthest depth of the tiles in rows
+         * [row0, row_end), both multiples of FB_TILE or row_end = height.
+         */
+        void updateTiles(int row0, int row_end);
+
+        inline float at(int y, int x) const {
+            return depths[(size_t) (y / FB_TILE * tiles_x + x / FB_TILE) * (FB_TILE * FB_TILE) +
+                          (y % FB_TILE) * FB_TILE + x % FB_TILE];
+        }
+
+        /**
+         * Appends to visible the runs of the line a, b whose depths,
+         * interpolated from za and zb, are no farther than the buffer's
+         * plus bias. A line visible throughout is appended as is.
+         */
+        line_test_t clipLine(grid_vertex_t a, float za, grid_vertex_t b, float zb, float bias,
+                             vector<grid_edge_t> &visible) const;
+
+        /**
+         * Returns the bytes of depth and tile storage in use.
+         */
+        size_t bytesAllocated() const;
+
+    private:
+        /* Tiles per row of tiles */
+        int tiles_x = 0;
+        vector<float> depths;
+        /* Nearest and farthest depth of each tile */
+        vector<float> tile_near, tile_far;
+};
+
+#endif
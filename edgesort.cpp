@@ -0,0 +1,100 @@
+#include <algorithm>
+
+#include "edgesort.h"
+
+uint64_t hilbertIndex(uint32_t side, uint32_t x, uint32_t y) {
+    uint64_t d = 0;
+    for (uint32_t s = side / 2; s > 0; s /= 2) {
+        uint32_t rx = (x & s) > 0;
+        uint32_t ry = (y & s) > 0;
+        d += (uint64_t) s * s * ((3 * rx) ^ ry);
+
+        // Rotates the quadrant so the curve inside it has the base orientation
+        if (ry == 0) {
+            if (rx == 1) {
+                x = side - 1 - x;
+                y = side - 1 - y;
+            }
+            swap(x, y);
+        }
+    }
+    return d;
+}
+
+void sortEdges(vector<grid_edge_t> &edges, int xres, int yres, edge_order_t order) {
+    if (order == EDGE_ORDER_SCENE) {
+        return;
+    }
+
+    uint32_t side = 1;
+    while (side < (uint32_t) max(xres, yres)) {
+        side *= 2;
+    }
+    uint64_t tiles_per_row = (xres + EDGE_SORT_TILE - 1) / EDGE_SORT_TILE;
+
+    /* Sorts (key, original index) pairs so equal keys keep scene order */
+    vector<pair<uint64_t, uint32_t>> keys(edges.size());
+    for (size_t i = 0; i < edges.size(); i++) {
+        uint32_t mid_x = ((long long) edges[i].a.x + edges[i].b.x) / 2;
+        uint32_t mid_y = ((long long) edges[i].a.y + edges[i].b.y) / 2;
+        uint64_t key;
+        if (order == EDGE_ORDER_TILE) {
+            key = (mid_y / EDGE_SORT_TILE) * tiles_per_row + mid_x / EDGE_SORT_TILE;
+        } else {
+            key = hilbertIndex(side, mid_x, mid_y);
+        }
+        keys[i] = {key, (uint32_t) i};
+    }
+    sort(keys.begin(), keys.end());
+
+    vector<grid_edge_t> sorted(edges.size());
+    for (size_t i = 0; i < keys.size(); i++) {
+        sorted[i] = edges[keys[i].second];
+    }
+    edges.swap(sorted);
+}
+
+void collapseEdges(vector<grid_edge_t> &edges, int xres, int yres,
+                   long long &collapsed, long long &dropped) {
+    collapsed = 0;
+    dropped = 0;
+    vector<grid_edge_t> kept;
+    kept.reserve(edges.size());
+    for (const grid_edge_t &e : edges) {
+        if (abs(e.a.x - e.b.x) > 1 || abs(e.a.y - e.b.y) > 1) {
+            kept.push_back(e);
+            continue;
+        }
+        collapsed++;
+        kept.push_back(initGridEdge(e.a, e.a));
+        if (e.a.x != e.b.x || e.a.y != e.b.y) {
+            kept.push_back(initGridEdge(e.b, e.b));
+        }
+    }
+
+    /* Walks backwards so the last of each repeated point is kept */
+    const int words = EDGE_SORT_TILE * EDGE_SORT_TILE / 64;
+    int tiles_x = (xres + EDGE_SORT_TILE - 1) / EDGE_SORT_TILE;
+    int tiles_y = (yres + EDGE_SORT_TILE - 1) / EDGE_SORT_TILE;
+    vector<vector<uint64_t>> seen((size_t) tiles_x * tiles_y);
+    size_t out = kept.size();
+    for (size_t i = kept.size(); i-- > 0;) {
+        grid_vertex_t p = kept[i].a;
+        if (p.x == kept[i].b.x && p.y == kept[i].b.y && p.x >= 0 && p.x < xres &&
+                p.y >= 0 && p.y < yres) {
+            vector<uint64_t> &tile = seen[(size_t) (p.y / EDGE_SORT_TILE) * tiles_x + 
+                                          p.x / EDGE_SORT_TILE];
+            if (tile.empty()) {
+                tile.assign(words, 0);
+            }
+            int bit = (p.y % EDGE_SORT_TILE) * EDGE_SORT_TILE + p.x % EDGE_SORT_TILE;
+            if (tile[bit / 64] & (1ULL << (bit % 64))) {
+                dropped++;
+                continue;
+            }
+            tile[bit / 64] |= 1ULL << (bit % 64);
+        }
+        kept[--out] = kept[i];
+    }
+    edges.assign(kept.begin() + out, kept.end());
+}
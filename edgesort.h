@@ -0,0 +1,48 @@
+#ifndef EDGESORT_H
+#define EDGESORT_H
+
+#include <cstdint>
+#include <vector>
+#include "object.h"
+
+using namespace std;
+
+/* Side in pixels of the square tiles used by EDGE_ORDER_TILE */
+const int EDGE_SORT_TILE = 64;
+
+typedef enum edgeOrder {
+    /* Scene order: copies by name, then faces in file order */
+    EDGE_ORDER_SCENE,
+    /* Row-major order of the EDGE_SORT_TILE square tile holding the midpoint */
+    EDGE_ORDER_TILE,
+    /* Position of the midpoint along a Hilbert curve over the grid */
+    EDGE_ORDER_HILBERT
+} edge_order_t;
+
+/**
+ * Returns the distance of (x, y) along the Hilbert curve filling
+ * the side x side grid, side being a power of 2.
+ */
+uint64_t hilbertIndex(uint32_t side, uint32_t x, uint32_t y);
+
+/**
+ * Stably reorders edges on an xres by yres grid so consecutive edges
+ * touch nearby parts of the framebuffer. Does nothing for EDGE_ORDER_SCENE.
+ */
+void sortEdges(vector<grid_edge_t> &edges, int xres, int yres, edge_order_t order);
+
+/**
+ * Replaces every edge of one-pixel lines, whose ends are the same or
+ * neighboring pixels, by a point edge (a == b) for each end: Bresenham
+ * draws such lines as their ends at full shade. Then drops every point
+ * edge a later point edge repeats, found with a bitmap per EDGE_SORT_TILE
+ * tile the points touch. Drawing the result one pixel wide in order gives
+ * the same image as the original edges, as the last write to a pixel wins.
+ *
+ * @param collapsed set to the number of edges turned into points
+ * @param dropped set to the number of repeated points left out
+ */
+void collapseEdges(vector<grid_edge_t> &edges, int xres, int yres,
+                   long long &collapsed, long long &dropped);
+
+#endif
@@ -0,0 +1,200 @@
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+#include "framebuffer.h"
+
+Framebuffer::Framebuffer(const Framebuffer &other) {
+    *this = other;
+}
+
+Framebuffer::Framebuffer(Framebuffer &&other) noexcept {
+    *this = std::move(other);
+}
+
+Framebuffer &Framebuffer::operator=(const Framebuffer &other) {
+    if (this == &other) {
+        return *this;
+    }
+    release();
+    width = other.width;
+    height = other.height;
+    layout = other.layout;
+    if (other.data == nullptr && other.tiles.empty()) {
+        return *this;
+    }
+
+    allocate(other.width, other.height, other.layout);
+    if (layout == FB_ROW_MAJOR) {
+        for (int y = 0; y < height; y++) {
+            memcpy(&data[(size_t) y * stride], &other.data[(size_t) y * other.stride],
+                   width * sizeof(float));
+        }
+        return *this;
+    }
+    if (layout != FB_SPARSE) {
+        memcpy(data, other.data, data_cells * sizeof(float));
+        return *this;
+    }
+    for (size_t t = 0; t < tiles.size(); t++) {
+        if (other.tiles[t] != nullptr) {
+            allocateTile(t);
+            memcpy(tiles[t], other.tiles[t], FB_TILE * FB_TILE * sizeof(float));
+        }
+    }
+    return *this;
+}
+
+Framebuffer &Framebuffer::operator=(Framebuffer &&other) noexcept {
+    if (this == &other) {
+        return *this;
+    }
+    width = other.width;
+    height = other.height;
+    layout = other.layout;
+    storage = std::move(other.storage);
+    data = other.data;
+    data_cells = other.data_cells;
+    stride = other.stride;
+    tiles_x = other.tiles_x;
+    tiles = std::move(other.tiles);
+    chunks = std::move(other.chunks);
+    chunk_used = other.chunk_used;
+    row_tiles = std::move(other.row_tiles);
+
+    other.data = nullptr;
+    other.data_cells = 0;
+    other.tiles.clear();
+    other.chunks.clear();
+    other.row_tiles.clear();
+    return *this;
+}
+
+void Framebuffer::allocate(int width, int height, fb_layout_t layout) {
+    this->width = width;
+    this->height = height;
+    this->layout = layout;
+    stride = width;
+
+    /* Pads the grid to whole tiles */
+    tiles_x = (width + FB_TILE - 1) / FB_TILE;
+    int tiles_y = (height + FB_TILE - 1) / FB_TILE;
+
+    if (layout == FB_SPARSE) {
+        data_cells = 0;
+        tiles.assign((size_t) tiles_x * tiles_y, nullptr);
+        row_tiles.assign(tiles_y, 0);
+        chunk_used = SPARSE_CHUNK_TILES;
+        return;
+    }
+
+    if (layout == FB_ROW_MAJOR) {
+        data_cells = (size_t) width * height;
+    } else {
+        data_cells = (size_t) tiles_x * tiles_y * FB_TILE * FB_TILE;
+    }
+    storage.reset((float *) calloc(data_cells, sizeof(float)));
+    data = storage.get();
+    if (data == nullptr && data_cells > 0) {
+        throw std::runtime_error("Could not allocate the Pixel Grid.");
+    }
+}
+
+void Framebuffer::wrap(float *pixels, int width, int height, size_t stride) {
+    release();
+    this->width = width;
+    this->height = height;
+    this->stride = stride;
+    layout = FB_ROW_MAJOR;
+    data = pixels;
+    /* Spans the padding between rows, which clear leaves as it is */
+    data_cells = height > 0 ? (size_t) (height - 1) * stride + width : 0;
+}
+
+void Framebuffer::release() {
+    storage.reset();
+    data = nullptr;
+    data_cells = 0;
+    chunks.clear();
+    std::vector<float *>().swap(tiles);
+    std::vector<int>().swap(row_tiles);
+}
+
+void Framebuffer::clear() {
+    if (layout == FB_ROW_MAJOR && stride != (size_t) width) {
+        for (int y = 0; y < height; y++) {
+            memset(&data[(size_t) y * stride], 0, width * sizeof(float));
+        }
+        return;
+    }
+    if (layout != FB_SPARSE) {
+        memset(data, 0, data_cells * sizeof(float));
+        return;
+    }
+    chunks.clear();
+    chunk_used = SPARSE_CHUNK_TILES;
+    std::fill(tiles.begin(), tiles.end(), nullptr);
+    std::fill(row_tiles.begin(), row_tiles.end(), 0);
+}
+
+void Framebuffer::allocateTile(size_t t) {
+    if (chunk_used == SPARSE_CHUNK_TILES) {
+        storage_t chunk((float *) calloc(SPARSE_CHUNK_TILES * FB_TILE * FB_TILE, sizeof(float)));
+        if (chunk == nullptr) {
+            throw std::runtime_error("Could not allocate a Pixel Grid tile.");
+        }
+        chunks.push_back(std::move(chunk));
+        chunk_used = 0;
+    }
+    tiles[t] = chunks.back().get() + chunk_used * FB_TILE * FB_TILE;
+    chunk_used++;
+    row_tiles[t / tiles_x]++;
+}
+
+size_t Framebuffer::bytesAllocated() const {
+    return (storage ? data_cells * sizeof(float) : 0)
+         + chunks.size() * SPARSE_CHUNK_TILES * FB_TILE * FB_TILE * sizeof(float)
+         + tiles.capacity() * sizeof(float *)
+         + row_tiles.capacity() * sizeof(int);
+}
+
+void Framebuffer::readRow(int y, float *out) const {
+    if (layout == FB_ROW_MAJOR) {
+        memcpy(out, &data[(size_t) y * stride], width * sizeof(float));
+        return;
+    }
+
+    /* Gathers the row's FB_TILE pixels from each tile it crosses */
+    size_t first_tile = (size_t) (y / FB_TILE) * tiles_x;
+    unsigned odd = morton(y % FB_TILE, 0);
+    for (int x0 = 0; x0 < width; x0 += FB_TILE) {
+        int n = (width - x0 < FB_TILE) ? width - x0 : FB_TILE;
+        const float *tile;
+        if (layout == FB_SPARSE) {
+            tile = tiles[first_tile + x0 / FB_TILE];
+            if (tile == nullptr) {
+                memset(&out[x0], 0, n * sizeof(float));
+                continue;
+            }
+        } else {
+            tile = &data[(first_tile + x0 / FB_TILE) * FB_TILE * FB_TILE];
+        }
+        for (int i = 0; i < n; i++) {
+            out[x0 + i] = tile[odd | morton(0, i)];
+        }
+    }
+}
+
+frame_view_t Framebuffer::view() const {
+    if (layout != FB_ROW_MAJOR) {
+        throw std::logic_error("Only a row-major Pixel Grid can be viewed directly.");
+    }
+    frame_view_t v;
+    v.pixels = data;
+    v.width = width;
+    v.height = height;
+    v.stride = stride;
+    v.format = PIXEL_GRAY_F32;
+    return v;
+}
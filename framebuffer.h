@@ -0,0 +1,219 @@
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+/* Side of the square tiles used by FB_TILED and FB_SPARSE */
+const int FB_TILE = 16;
+
+typedef enum fbLayout {
+    /* One row after another, as the PPM is written */
+    FB_ROW_MAJOR,
+    /* FB_TILE x FB_TILE tiles in row-major order, Morton (Z) order inside
+       each tile, so every 64 byte cache line holds a 4 x 4 pixel block */
+    FB_TILED,
+    /* Same tiles as FB_TILED, but each one is only allocated on its first
+       write; unwritten tiles read as 0 */
+    FB_SPARSE
+} fb_layout_t;
+
+typedef enum pixelFormat {
+    /* One 32-bit float per pixel, the shade in [0, 1] of a white line
+       on a black background */
+    PIXEL_GRAY_F32
+} pixel_format_t;
+
+/**
+ * Read-only view of pixels owned by someone else: height rows of width
+ * pixels in format, each row starting stride pixels after the one before.
+ * Only valid while its owner keeps the pixels as they are.
+ */
+typedef struct frameView {
+    const float *pixels;
+    int width;
+    int height;
+    size_t stride;
+    pixel_format_t format;
+
+    inline const float *row(int y) const {
+        return pixels + y * stride;
+    }
+} frame_view_t;
+
+/**
+ * Pixel Grid of shades in [0, 1] stored in one of several memory layouts.
+ * Rasterizers write through set/get, which hide the layout, and encoders
+ * read it back a row at a time through readRow.
+ *
+ * A Framebuffer owns its storage: it is freed by release or on
+ * destruction, a copy gets storage of its own holding the same pixels,
+ * and a move hands the storage over, leaving the source empty. The one
+ * exception is a grid made by wrap, which draws into storage its caller
+ * owns and keeps alive.
+ */
+class Framebuffer {
+    public:
+        int width = 0, height = 0;
+        fb_layout_t layout = FB_ROW_MAJOR;
+
+        Framebuffer() = default;
+        Framebuffer(const Framebuffer &other);
+        Framebuffer(Framebuffer &&other) noexcept;
+        Framebuffer &operator=(const Framebuffer &other);
+        Framebuffer &operator=(Framebuffer &&other) noexcept;
+
+        /**
+         * Allocates a zeroed width by height grid stored with layout.
+         * This is the only malloced data, freed by release.
+         */
+        void allocate(int width, int height, fb_layout_t layout);
+
+        /**
+         * Makes this an FB_ROW_MAJOR grid stored in pixels, which the
+         * caller owns and must keep alive while the grid is used: width
+         * by height shades, each row starting stride floats after the one
+         * before. Frees any storage of its own; leaves pixels as they are.
+         */
+        void wrap(float *pixels, int width, int height, size_t stride);
+
+        /**
+         * Frees the grid's data.
+         */
+        void release();
+
+        /**
+         * Zeroes every pixel. Dense layouts keep their storage for reuse,
+         * FB_SPARSE hands its tiles back.
+         */
+        void clear();
+
+        /**
+         * Sets the shade of pixel (y, x), which must lie on the grid.
+         */
+        inline void set(int y, int x, float shade) {
+            if (layout == FB_SPARSE) {
+                size_t t = tileIndex(y, x);
+                if (tiles[t] == nullptr) {
+                    allocateTile(t);
+                }
+                tiles[t][morton(y % FB_TILE, x % FB_TILE)] = shade;
+                return;
+            }
+            data[offset(y, x)] = shade;
+        }
+
+        /**
+         * Returns the shade of pixel (y, x), which must lie on the grid.
+         */
+        inline float get(int y, int x) const {
+            if (layout == FB_SPARSE) {
+                const float *tile = tiles[tileIndex(y, x)];
+                return tile ? tile[morton(y % FB_TILE, x % FB_TILE)] : 0;
+            }
+            return data[offset(y, x)];
+        }
+
+        /**
+         * Returns the address pixel (y, x) is stored at,
+         * or nullptr if it's in an unallocated FB_SPARSE tile.
+         */
+        inline const float *address(int y, int x) const {
+            if (layout == FB_SPARSE) {
+                const float *tile = tiles[tileIndex(y, x)];
+                return tile ? &tile[morton(y % FB_TILE, x % FB_TILE)] : nullptr;
+            }
+            return &data[offset(y, x)];
+        }
+
+        /**
+         * Returns true if no pixel of row y can be non-zero, i.e. none of
+         * the FB_SPARSE tiles crossing it were written. Always false for
+         * the dense layouts.
+         */
+        inline bool rowEmpty(int y) const {
+            return layout == FB_SPARSE && row_tiles[y / FB_TILE] == 0;
+        }
+
+        /**
+         * Returns true if the FB_TILE pixels of row y starting at x0, a 
+         * multiple of FB_TILE, lie in an unwritten FB_SPARSE tile.
+         * Always false for the dense layouts.
+         */
+        inline bool tileEmpty(int y, int x0) const {
+            return layout == FB_SPARSE && tiles[tileIndex(y, x0)] == nullptr;
+        }
+
+        /**
+         * Returns the bytes of pixel and tile table storage allocated.
+         */
+        size_t bytesAllocated() const;
+
+        /**
+         * Copies row y into out in left to right order.
+         * @param out, holds at least width floats
+         */
+        void readRow(int y, float *out) const;
+
+        /**
+         * Returns a view of the grid's own storage, without copying it.
+         * Only FB_ROW_MAJOR grids are laid out as a view needs.
+         * 
+         * @throws logic_error for the tiled layouts
+         */
+        frame_view_t view() const;
+
+    private:
+        struct FreeDeleter {
+            void operator()(float *p) const {
+                free(p);
+            }
+        };
+        typedef std::unique_ptr<float, FreeDeleter> storage_t;
+
+        /* Pixels of the dense layouts, held by storage unless wrapped */
+        storage_t storage;
+        float *data = nullptr;
+        size_t data_cells = 0;
+        /* FB_ROW_MAJOR: floats from the start of one row to the next */
+        size_t stride = 0;
+        /* Tiles per row of tiles for FB_TILED and FB_SPARSE */
+        int tiles_x = 0;
+
+        /* FB_SPARSE: pointer to each tile, null until written, carved out 
+           of chunks of SPARSE_CHUNK_TILES zeroed tiles */
+        std::vector<float *> tiles;
+        std::vector<storage_t> chunks;
+        size_t chunk_used = 0;
+        /* FB_SPARSE: allocated tiles per row of tiles */
+        std::vector<int> row_tiles;
+
+        static const size_t SPARSE_CHUNK_TILES = 64;
+
+        void allocateTile(size_t t);
+
+        inline size_t tileIndex(int y, int x) const {
+            return (size_t) (y / FB_TILE) * tiles_x + x / FB_TILE;
+        }
+
+        inline size_t offset(int y, int x) const {
+            if (layout == FB_ROW_MAJOR) {
+                return (size_t) y * stride + x;
+            }
+            return tileIndex(y, x) * (FB_TILE * FB_TILE) + morton(y % FB_TILE, x % FB_TILE);
+        }
+
+        /* Interleaves the bits of x (even) and y (odd) within a tile */
+        static inline unsigned morton(unsigned y, unsigned x) {
+            static const uint8_t spread[FB_TILE] = {
+                0x00, 0x01, 0x04, 0x05, 0x10, 0x11, 0x14, 0x15,
+                0x40, 0x41, 0x44, 0x45, 0x50, 0x51, 0x54, 0x55
+            };
+            return spread[x] | (spread[y] << 1);
+        }
+};
+
+#endif
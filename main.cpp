@@ -0,0 +1,329 @@
+#include <iostream>
+#include <thread>
+
+#include "wireframe.h"
+#include "batch.h"
+#include "server.h"
+
+
+void usage(void) {
+    cerr << "Enter input in the form: scene_description_file.txt xres yres [options]\n\t"
+            "xres, yres must be positive integers; a .wfs binary scene\n\t"
+            "file can stand in for the .txt file\n"
+            "or, to render many scenes: --batch list.txt [options]\n\t"
+            "list.txt holds one 'scene_description_file.txt xres yres' per line\n"
+            "or, to serve render requests: --serve socket_path [options]\n"
+            "Options:\n\t"
+            "--ssaa N          supersample N x N per pixel (1 to " 
+         << MAX_SSAA_FACTOR << ")\n\t"
+            "--filter box|tent downsampling filter used with --ssaa\n\t"
+            "--line-width W    draw lines W pixels wide\n\t"
+            "--sort-edges scene|tile|hilbert\n\t"
+            "                  order in which lines are rasterized\n\t"
+            "--cull none|backface|hidden\n\t"
+            "                  leave out the lines of faces turned away,\n\t"
+            "                  or every line hidden behind a face\n\t"
+            "--edges all|outline\n\t"
+            "                  draw every edge, or only silhouette, border\n\t"
+            "                  and crease edges\n\t"
+            "--crease-angle DEG\n\t"
+            "                  fold between faces above which --edges outline\n\t"
+            "                  draws their edge (default 45)\n\t"
+            "--lod PIXELS      draw far copies from simplified meshes, off\n\t"
+            "                  by at most PIXELS pixels\n\t"
+            "--bands ROWS      render and write ROWS rows at a time\n\t"
+            "--layout rowmajor|tiled|sparse\n\t"
+            "                  memory layout of the Pixel Grid\n\t"
+            "--animation FILE  render the frames of a keyframed animation\n\t"
+            "--save-scene FILE also write the scene read in as a .wfs file\n\t"
+            "--threads N       run on N threads, by default one per core; the\n\t"
+            "                  server also serves up to N connections at once\n\t"
+            "--pin             bind each thread to its own core\n\t"
+            "--deterministic   give each thread a fixed share of the work\n\t"
+            "--queue N         let up to N clients wait for a server thread\n\t"
+            "--mesh-budget MB  keep at most MB megabytes of batch or server meshes\n\t"
+            "--stats           print stage timings and counters to stderr\n\t"
+            "--cache-model     also simulate framebuffer cache misses (slow)\n";
+    exit(1);
+}
+
+/* Command line settings that aren't Wireframe properties */
+typedef struct runOptions {
+    string animation_file = "";
+    /* Binary scene file the scene read in is written to, if any */
+    string scene_output = "";
+    /* Scheduler threads, and server connection threads, 0 for one per core */
+    int threads = 0;
+    /* Scheduler options */
+    bool pin = false;
+    bool deterministic = false;
+    /* Connections the server lets wait for a worker */
+    int queue_size = 64;
+    /* Bytes of meshes batch and server modes keep, 0 for no limit */
+    size_t mesh_budget = 0;
+} run_options_t;
+
+/* Parses the optional arguments from argv[first] on into pipeline and options */
+void parseOptions(int argc, char *argv[], int first, Wireframe &pipeline, 
+                  run_options_t &options) {
+    for (int i = first; i < argc; i++) {
+        string opt = argv[i];
+        if (opt == "--stats") {
+            pipeline.stats.enabled = true;
+            continue;
+        } else if (opt == "--cache-model") {
+            pipeline.stats.enabled = true;
+            pipeline.stats.model_cache = true;
+            continue;
+        } else if (opt == "--pin") {
+            options.pin = true;
+            continue;
+        } else if (opt == "--deterministic") {
+            options.deterministic = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            usage();
+        }
+        string value = argv[++i];
+
+        if (opt == "--ssaa") {
+            pipeline.ssaa = stoi(value);
+            if (pipeline.ssaa < 1 || pipeline.ssaa > MAX_SSAA_FACTOR) {
+                usage();
+            }
+        } else if (opt == "--filter") {
+            if (value == "box") {
+                pipeline.ssaa_filter = SSAA_BOX;
+            } else if (value == "tent") {
+                pipeline.ssaa_filter = SSAA_TENT;
+            } else {
+                usage();
+            }
+        } else if (opt == "--sort-edges") {
+            if (value == "scene") {
+                pipeline.edge_order = EDGE_ORDER_SCENE;
+            } else if (value == "tile") {
+                pipeline.edge_order = EDGE_ORDER_TILE;
+            } else if (value == "hilbert") {
+                pipeline.edge_order = EDGE_ORDER_HILBERT;
+            } else {
+                usage();
+            }
+        } else if (opt == "--cull") {
+            if (value == "none") {
+                pipeline.cull_mode = CULL_NONE;
+            } else if (value == "backface") {
+                pipeline.cull_mode = CULL_BACKFACE;
+            } else if (value == "hidden") {
+                pipeline.cull_mode = CULL_HIDDEN;
+            } else {
+                usage();
+            }
+        } else if (opt == "--edges") {
+            if (value == "all") {
+                pipeline.edge_mode = EDGES_ALL;
+            } else if (value == "outline") {
+                pipeline.edge_mode = EDGES_OUTLINE;
+            } else {
+                usage();
+            }
+        } else if (opt == "--crease-angle") {
+            pipeline.crease_angle = stod(value);
+            if (pipeline.crease_angle < 0 || pipeline.crease_angle > 180) {
+                usage();
+            }
+        } else if (opt == "--lod") {
+            pipeline.lod_pixels = stod(value);
+            if (pipeline.lod_pixels < 0) {
+                usage();
+            }
+        } else if (opt == "--animation") {
+            options.animation_file = value;
+        } else if (opt == "--save-scene") {
+            options.scene_output = value;
+        } else if (opt == "--threads") {
+            options.threads = stoi(value);
+            if (options.threads <= 0) {
+                usage();
+            }
+        } else if (opt == "--mesh-budget") {
+            double megabytes = stod(value);
+            if (megabytes <= 0) {
+                usage();
+            }
+            options.mesh_budget = megabytes * (1 << 20);
+        } else if (opt == "--queue") {
+            options.queue_size = stoi(value);
+            if (options.queue_size <= 0) {
+                usage();
+            }
+        } else if (opt == "--bands") {
+            pipeline.band_rows = stoi(value);
+            if (pipeline.band_rows <= 0) {
+                usage();
+            }
+        } else if (opt == "--layout") {
+            if (value == "rowmajor") {
+                pipeline.fb_layout = FB_ROW_MAJOR;
+            } else if (value == "tiled") {
+                pipeline.fb_layout = FB_TILED;
+            } else if (value == "sparse") {
+                pipeline.fb_layout = FB_SPARSE;
+            } else {
+                usage();
+            }
+        } else if (opt == "--line-width") {
+            pipeline.line_width = stod(value);
+            if (pipeline.line_width <= 0) {
+                usage();
+            }
+        } else {
+            usage();
+        }
+    }
+
+    if (pipeline.band_rows > 0 && pipeline.ssaa > 1) {
+        usage();
+    }
+}
+
+/* Number of worker threads options asks for */
+int workerCount(const run_options_t &options) {
+    int threads = options.threads;
+    if (threads <= 0) {
+        threads = thread::hardware_concurrency();
+    }
+    return max(threads, 1);
+}
+
+/* Adds the counters of scheduler to stats */
+void addSchedulerStats(const Scheduler &scheduler, RenderStats &stats) {
+    if (stats.enabled) {
+        stats.addCount("scheduler threads", scheduler.threads());
+        stats.addCount("scheduler steals", scheduler.steals);
+    }
+}
+
+/* Renders every scene listed in argv[2], sharing one mesh cache */
+int batchMain(int argc, char *argv[]) {
+    Wireframe settings;
+    run_options_t options;
+    parseOptions(argc, argv, 3, settings, options);
+    if (!options.animation_file.empty() || !options.scene_output.empty()) {
+        usage();
+    }
+
+    vector<batch_job_t> jobs;
+    readBatchFile(argv[2], jobs);
+    MeshCache cache(options.mesh_budget);
+    Scheduler scheduler(workerCount(options), options.pin, options.deterministic);
+    settings.scheduler = &scheduler;
+    RenderStats totals;
+    totals.enabled = settings.stats.enabled;
+    int failed = renderBatch(jobs, settings, cache, totals);
+    addSchedulerStats(scheduler, totals);
+    if (totals.enabled) {
+        totals.print(cerr);
+    }
+    return failed > 0;
+}
+
+/* The options of settings a Renderer takes */
+render_options_t renderOptions(const Wireframe &settings) {
+    render_options_t options;
+    options.ssaa = settings.ssaa;
+    options.ssaa_filter = settings.ssaa_filter;
+    options.line_width = settings.line_width;
+    options.edge_order = settings.edge_order;
+    options.cull_mode = settings.cull_mode;
+    options.edge_mode = settings.edge_mode;
+    options.crease_angle = settings.crease_angle;
+    options.lod_pixels = settings.lod_pixels;
+    options.fb_layout = settings.fb_layout;
+    options.stats = settings.stats.enabled;
+    return options;
+}
+
+/* Serves render requests on the Unix socket argv[2] until interrupted */
+int serverMain(int argc, char *argv[]) {
+    Wireframe settings;
+    run_options_t options;
+    parseOptions(argc, argv, 3, settings, options);
+    if (!options.animation_file.empty() || !options.scene_output.empty() || 
+            settings.band_rows > 0) {
+        usage();
+    }
+
+    /* Before the scheduler's threads start, so they inherit the mask */
+    blockStopSignals();
+    Scheduler scheduler(workerCount(options), options.pin, options.deterministic);
+    RenderServer server(renderOptions(settings), workerCount(options), options.queue_size,
+                        options.mesh_budget, &scheduler);
+    server.serve(argv[2]);
+    addSchedulerStats(scheduler, server.stats);
+    if (server.stats.enabled) {
+        server.stats.print(cerr);
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc >= 3 && (string(argv[1]) == "--batch" || string(argv[1]) == "--serve")) {
+        try {
+            if (string(argv[1]) == "--batch") {
+                return batchMain(argc, argv);
+            }
+            return serverMain(argc, argv);
+        } catch (const exception &e) {
+            cerr << e.what() << endl;
+            return 1;
+        }
+    }
+    if (argc < 4) {
+        usage();
+    }
+
+    try {
+        Wireframe pipeline;
+        pipeline.xres = stoi(argv[2]);
+        pipeline.yres = stoi(argv[3]);
+        if (pipeline.xres <= 0 || pipeline.yres <= 0) {
+            usage();
+        }
+        run_options_t options;
+        parseOptions(argc, argv, 4, pipeline, options);
+        Scheduler scheduler(workerCount(options), options.pin, options.deterministic);
+        pipeline.scheduler = &scheduler;
+        pipeline.processFormatFile(argv[1]);
+        if (!options.scene_output.empty()) {
+            pipeline.saveSceneFile(options.scene_output);
+        }
+        if (!options.animation_file.empty()) {
+            Animation animation;
+            animation.processFile(options.animation_file);
+            pipeline.renderAnimation(animation, true);
+        } else {
+            pipeline.computeTransforms();
+            pipeline.applyTransforms();
+            if (pipeline.band_rows > 0) {
+                pipeline.renderBanded(true, true);
+            } else {
+                pipeline.plot(true);
+                pipeline.output(true);
+            }
+        }
+        pipeline.destruct();
+        addSchedulerStats(scheduler, pipeline.stats);
+        if (pipeline.stats.enabled) {
+            pipeline.stats.print(cerr);
+        }
+    } catch (const char *msg) {
+        cerr << msg << endl;
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,112 @@
+#include <chrono>
+#include <filesystem>
+
+#include "meshcache.h"
+#include "simplify.h"
+
+/* Key of path in the cache, the path itself if it can't be resolved */
+static string canonicalPath(const string &path) {
+    error_code ec;
+    filesystem::path resolved = filesystem::canonical(path, ec);
+    if (ec) {
+        return path;
+    }
+    return resolved.string();
+}
+
+/* Bytes held by the levels of detail of mesh */
+static size_t lodBytes(const Object &mesh) {
+    size_t bytes = mesh.lods.capacity() * sizeof(lod_level_t);
+    for (const lod_level_t &level : mesh.lods) {
+        bytes += meshBytes(*level.mesh);
+    }
+    return bytes;
+}
+
+size_t meshBytes(const Object &mesh) {
+    return mesh.vertexes.capacity() * sizeof(vertex_t) +
+           mesh.faces.capacity() * sizeof(face_t) +
+           mesh.normals.capacity() * sizeof(vertex_t) +
+           mesh.edges.capacity() * sizeof(mesh_edge_t) +
+           mesh.pixels.capacity() * sizeof(grid_vertex_t) +
+           lodBytes(mesh);
+}
+
+MeshCache::MeshCache(size_t budget) {
+    this->budget = budget;
+}
+
+shared_ptr<const Object> MeshCache::acquire(const string &path, bool lods) {
+    /* Meshes with levels of detail are cached under keys of their own */
+    string key = canonicalPath(path) + (lods ? "\nlods" : "");
+
+    unique_lock<mutex> guard(lock);
+    evict();
+    map<string, entry_t>::iterator found = meshes.find(key);
+    if (found != meshes.end()) {
+        hits++;
+        lru.splice(lru.begin(), lru, found->second.used);
+        shared_future<shared_ptr<const Object>> mesh = found->second.mesh;
+        /* Takes the reference under the lock when it can so the mesh is
+           pinned before evict could see it unused */
+        if (mesh.wait_for(chrono::seconds(0)) == future_status::ready) {
+            return mesh.get();
+        }
+        guard.unlock();
+        return mesh.get();
+    }
+    misses++;
+    promise<shared_ptr<const Object>> loading;
+    lru.push_front(key);
+    meshes.insert({key, {loading.get_future().share(), 0, lru.begin()}});
+    guard.unlock();
+
+    /* Parses outside the lock so other meshes can load meanwhile */
+    shared_ptr<const Object> mesh;
+    try {
+        shared_ptr<Object> parsed = make_shared<Object>(path);
+        if (lods) {
+            buildLods(*parsed);
+        }
+        mesh = parsed;
+    } catch (...) {
+        loading.set_exception(current_exception());
+        guard.lock();
+        found = meshes.find(key);
+        if (found != meshes.end()) {
+            lru.erase(found->second.used);
+            meshes.erase(found);
+        }
+        throw;
+    }
+    loading.set_value(mesh);
+
+    guard.lock();
+    found = meshes.find(key);
+    if (found != meshes.end()) {
+        found->second.bytes = meshBytes(*mesh);
+        resident_bytes += found->second.bytes;
+    }
+    evict();
+    return mesh;
+}
+
+void MeshCache::evict() {
+    if (budget == 0) {
+        return;
+    }
+    list<string>::iterator key = lru.end();
+    while (resident_bytes > budget && key != lru.begin()) {
+        --key;
+        map<string, entry_t>::iterator found = meshes.find(*key);
+        entry_t &e = found->second;
+        /* Skips meshes being parsed and meshes renders still hold */
+        if (e.bytes == 0 || e.mesh.get().use_count() > 1) {
+            continue;
+        }
+        resident_bytes -= e.bytes;
+        evictions++;
+        meshes.erase(found);
+        key = lru.erase(key);
+    }
+}
@@ -0,0 +1,87 @@
+#ifndef MESHCACHE_H
+#define MESHCACHE_H
+
+#include <cstddef>
+#include <future>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "object.h"
+
+using namespace std;
+
+/**
+ * Process-wide store of parsed .obj meshes shared between renders.
+ *
+ * Meshes are keyed by the canonical path of their file, so the same file
+ * reached through different relative paths is parsed once. They are handed
+ * out as reference-counted read-only Objects: every Wireframe using a mesh
+ * holds a reference to it, and the cache holds one more to keep it
+ * resident for later renders.
+ *
+ * With a budget, the cache keeps the bytes of its resident meshes under
+ * it by dropping the least recently acquired ones. A mesh still referenced
+ * outside the cache is pinned by the render using it and is skipped, so the
+ * budget can be exceeded while those renders run; the next acquire after
+ * they finish brings the cache back under it.
+ */
+class MeshCache {
+    public:
+        /* Number of acquire calls served from, and loaded into, the cache */
+        long long hits = 0;
+        long long misses = 0;
+        /* Number of meshes dropped to stay under budget */
+        long long evictions = 0;
+        /* Bytes of the meshes currently resident */
+        size_t resident_bytes = 0;
+
+        /**
+         * @param budget in bytes of resident meshes, 0 for no limit
+         */
+        MeshCache(size_t budget = 0);
+
+        /**
+         * Returns the mesh in the .obj file at path, parsing it if it isn't
+         * resident. Safe to call from several threads at once; threads
+         * asking for a mesh that is still being parsed wait for it.
+         *
+         * @param path of the .obj file
+         * @param lods if true, the mesh comes with its levels of detail
+         *        (see simplify.h), and is cached apart from the mesh without
+         * @throws invalid_argument if it fails to read the file, in which
+         *         case a later call will try again
+         */
+        shared_ptr<const Object> acquire(const string &path, bool lods = false);
+
+    private:
+        typedef struct entry {
+            shared_future<shared_ptr<const Object>> mesh;
+            /* 0 while the mesh is being parsed */
+            size_t bytes;
+            /* Position in lru */
+            list<string>::iterator used;
+        } entry_t;
+
+        size_t budget;
+        mutex lock;
+        /* Meshes by canonical path, possibly still being parsed */
+        map<string, entry_t> meshes;
+        /* Keys of meshes, most recently acquired first */
+        list<string> lru;
+
+        /**
+         * Drops unpinned meshes, least recently acquired first, until
+         * resident_bytes fits the budget. Must be called holding lock.
+         */
+        void evict();
+};
+
+/**
+ * Returns the bytes held by mesh's vertex, face, normal, edge and pixel
+ * arrays and by its levels of detail.
+ */
+size_t meshBytes(const Object &mesh);
+
+#endif
@@ -3,6 +3,9 @@
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
 
 #include "utils.h"
 
@@ -31,6 +34,13 @@ grid_vertex_t initGridVertex(int a, int b) {
     return v;
 }
 
+grid_edge_t initGridEdge(grid_vertex_t a, grid_vertex_t b) {
+    grid_edge_t e;
+    e.a = a;
+    e.b = b;
+    return e;
+}
+
 void Object::init() {
     vertexes.push_back(initVertex(0, 0, 0));
     pixels.push_back(initGridVertex(0, 0));
@@ -45,11 +55,16 @@ Object::Object(string filename) {
     processFile(filename);
 }
 
-Object Object::copy() {
+Object Object::copy() const {
     Object copy;
     copy.name = name;
     copy.vertexes = vertexes;
     copy.faces = faces;
+    copy.normals = normals;
+    copy.edges = edges;
+    copy.bound_center = bound_center;
+    copy.bound_radius = bound_radius;
+    copy.mirrored = mirrored;
     return copy;
 }
 
@@ -86,6 +101,56 @@ void Object::processFile(string filename) {
     }
 
     file.close();
+    computeTopology();
+}
+
+void Object::computeTopology() {
+    /* The sphere around the middle of the bounding box, which is within
+       sqrt(3) of the smallest */
+    if (vertexes.size() > 1) {
+        vertex_t low = vertexes[1], high = vertexes[1];
+        for (size_t i = 2; i < vertexes.size(); i++) {
+            low = initVertex(min(low.x, vertexes[i].x), min(low.y, vertexes[i].y), 
+                             min(low.z, vertexes[i].z));
+            high = initVertex(max(high.x, vertexes[i].x), max(high.y, vertexes[i].y), 
+                              max(high.z, vertexes[i].z));
+        }
+        bound_center = initVertex((low.x + high.x) / 2, (low.y + high.y) / 2, (low.z + high.z) / 2);
+        bound_radius = 0;
+        for (size_t i = 1; i < vertexes.size(); i++) {
+            double dx = vertexes[i].x - bound_center.x, dy = vertexes[i].y - bound_center.y,
+                   dz = vertexes[i].z - bound_center.z;
+            bound_radius = max(bound_radius, sqrt(dx * dx + dy * dy + dz * dz));
+        }
+    }
+
+    normals.resize(faces.size());
+    edges.clear();
+    unordered_map<uint64_t, int> found;
+    found.reserve(faces.size() * 2);
+
+    for (size_t f = 0; f < faces.size(); f++) {
+        int idx[3] = {faces[f].v1, faces[f].v2, faces[f].v3};
+        vertex_t a = vertexes[idx[0]], b = vertexes[idx[1]], c = vertexes[idx[2]];
+        double ux = b.x - a.x, uy = b.y - a.y, uz = b.z - a.z;
+        double vx = c.x - a.x, vy = c.y - a.y, vz = c.z - a.z;
+        vertex_t n = initVertex(uy * vz - uz * vy, uz * vx - ux * vz, ux * vy - uy * vx);
+        double length = sqrt(n.x * n.x + n.y * n.y + n.z * n.z);
+        normals[f] = (length > 0) ? initVertex(n.x / length, n.y / length, n.z / length) : n;
+
+        for (int e = 0; e < 3; e++) {
+            int i = idx[e], j = idx[(e + 1) % 3];
+            uint64_t key = ((uint64_t) min(i, j) << 32) | (uint32_t) max(i, j);
+            unordered_map<uint64_t, int>::iterator edge = found.find(key);
+            if (edge != found.end() && edges[edge->second].f2 < 0) {
+                edges[edge->second].f2 = f;
+                continue;
+            }
+            mesh_edge_t added = {i, j, (int) f, -1};
+            found[key] = edges.size();
+            edges.push_back(added);
+        }
+    }
 }
 
 void Object::printContents() {
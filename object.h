@@ -3,6 +3,7 @@
  
 #include <vector>
 #include <string>
+#include <memory>
 #include <stdexcept>
 
 using namespace std;
@@ -30,15 +31,58 @@ typedef struct gridVertex {
 
 grid_vertex_t initGridVertex(int a, int b);
 
+/* Line between two Pixel Grid vertexes */
+typedef struct gridEdge {
+    grid_vertex_t a;
+    grid_vertex_t b;
+} grid_edge_t;
+
+grid_edge_t initGridEdge(grid_vertex_t a, grid_vertex_t b);
+
+/* Edge of a mesh and the faces on either side of it */
+typedef struct meshEdge {
+    int v1;
+    int v2;
+    /* Indexes into faces; f2 is -1 if only one face has the edge */
+    int f1;
+    int f2;
+} mesh_edge_t;
+
+class Object;
+
+/* Simplified version of a mesh */
+typedef struct lodLevel {
+    shared_ptr<const Object> mesh;
+    /* Farthest, roughly, any point of mesh lies from the full mesh's
+       surface, in the full mesh's units */
+    double error;
+} lod_level_t;
+
 class Object {
     public:
         string name;
         vector<vertex_t> vertexes;
         vector<face_t> faces;
+        /* Unit normal of each face, facing the side it winds
+           counterclockwise seen from */
+        vector<vertex_t> normals;
+        /* Every edge of the faces, once */
+        vector<mesh_edge_t> edges;
+        /* Sphere holding every vertex */
+        vertex_t bound_center = {0, 0, 0};
+        double bound_radius = 0;
+        /* Ever coarser versions of the mesh, if built (see simplify.h) */
+        vector<lod_level_t> lods;
+        /* True if the transform applied to vertexes mirrored them, 
+           reversing the winding of faces */
+        bool mirrored = false;
 
         /* All of Object's vertexes that are inside the 
            perspective cube mapped to a 2D NDC pixel grid */
         vector<grid_vertex_t> pixels;
+        /* NDC depth of each of pixels, NaN behind the camera; only
+           computed when hidden lines are removed */
+        vector<float> depths;
 
         /**
          * Base constructor that simply initializes vertexes and faces.
@@ -55,11 +99,13 @@ class Object {
         Object(string filename);
 
         /**
-         * Returns a deep copy of the object.
+         * Returns a deep copy of the object, without lods. Copies are
+         * transformed away from the mesh the levels were made from, so
+         * they're never a source of levels themselves.
          * 
          * @returns a deep copy of Object
          */
-        Object copy();
+        Object copy() const;
 
         /** 
          * Populates Object with the vertexes and faces
@@ -72,6 +118,14 @@ class Object {
          */ 
         void processFile(string filename);
 
+        /**
+         * Computes normals, edges and the bounding sphere from vertexes 
+         * and faces. Edges with
+         * more than two faces are split into single-face edges after the
+         * first two faces. processFile calls this once the file is read.
+         */
+        void computeTopology();
+
         /**
          * Prints out all the vertexes and faces.
          */
@@ -0,0 +1,42 @@
+#include "pipeline.h"
+
+OrderedStage::OrderedStage(size_t depth) : jobs(depth) {
+    worker = thread(&OrderedStage::work, this);
+}
+
+OrderedStage::~OrderedStage() {
+    try {
+        finish();
+    } catch (...) {
+    }
+}
+
+void OrderedStage::submit(function<void()> job) {
+    jobs.push(move(job));
+}
+
+void OrderedStage::finish() {
+    if (!finished) {
+        finished = true;
+        jobs.close();
+        worker.join();
+    }
+    if (error) {
+        exception_ptr thrown = error;
+        error = nullptr;
+        rethrow_exception(thrown);
+    }
+}
+
+void OrderedStage::work() {
+    function<void()> job;
+    while (jobs.pop(job)) {
+        try {
+            job();
+        } catch (...) {
+            if (!error) {
+                error = current_exception();
+            }
+        }
+    }
+}
@@ -0,0 +1,115 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+using namespace std;
+
+/**
+ * Queue between two pipeline stages holding at most capacity items.
+ * A full queue makes push wait, so a fast producer is held back to the
+ * pace of its consumer instead of piling up items.
+ */
+template <typename T>
+class BoundedQueue {
+    public:
+        BoundedQueue(size_t capacity) : capacity(capacity) {}
+
+        /**
+         * Adds item, waiting while the queue is full. Returns false,
+         * dropping item, if the queue is closed.
+         */
+        bool push(T item) {
+            unique_lock<mutex> guard(lock);
+            not_full.wait(guard, [&]() { return closed || items.size() < capacity; });
+            if (closed) {
+                return false;
+            }
+            items.push_back(move(item));
+            not_empty.notify_one();
+            return true;
+        }
+
+        /**
+         * Takes the oldest item, waiting while the queue is empty.
+         * Returns false once the queue is closed and empty.
+         */
+        bool pop(T &item) {
+            unique_lock<mutex> guard(lock);
+            not_empty.wait(guard, [&]() { return closed || !items.empty(); });
+            if (items.empty()) {
+                return false;
+            }
+            item = move(items.front());
+            items.pop_front();
+            not_full.notify_one();
+            return true;
+        }
+
+        /**
+         * Wakes every waiting push and pop; items already queued are
+         * still handed out.
+         */
+        void close() {
+            lock_guard<mutex> guard(lock);
+            closed = true;
+            not_full.notify_all();
+            not_empty.notify_all();
+        }
+
+    private:
+        size_t capacity;
+        bool closed = false;
+        deque<T> items;
+        mutex lock;
+        condition_variable not_full, not_empty;
+};
+
+/**
+ * Last stage of a pipeline: runs the jobs submitted to it one at a time,
+ * in order, on a thread of its own, so the producer can go on with the
+ * next item while the last is written out. Up to depth jobs wait their
+ * turn; submit waits beyond that.
+ */
+class OrderedStage {
+    public:
+        OrderedStage(size_t depth);
+
+        /**
+         * Finishes the queued jobs, dropping any exception they threw.
+         */
+        ~OrderedStage();
+
+        OrderedStage(const OrderedStage &) = delete;
+        OrderedStage &operator=(const OrderedStage &) = delete;
+
+        /**
+         * Queues job after the ones already submitted, waiting while
+         * depth of them are queued.
+         */
+        void submit(function<void()> job);
+
+        /**
+         * Returns once every submitted job has run. Jobs after one that
+         * threw still run, so none of their resources are lost.
+         *
+         * @throws the first exception a job threw, if any
+         */
+        void finish();
+
+    private:
+        BoundedQueue<function<void()>> jobs;
+        thread worker;
+        bool finished = false;
+        exception_ptr error;
+
+        void work();
+};
+
+#endif
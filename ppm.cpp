@@ -0,0 +1,125 @@
+#include <iostream>
+#include <stdexcept>
+
+#include "color.h"
+#include "ppm.h"
+
+/* Text of one black pixel */
+static const string UNFILLED_STR = "0 0 0\n";
+
+PpmWriter::PpmWriter(string filename, int xres, int yres, bool printToStd) {
+    ppm.open(filename.c_str(), ios::out);
+    if (!ppm) {
+        string msg = "Could not create '" + filename + "'.";
+        throw runtime_error(msg);
+    }
+    out = &ppm;
+    this->printToStd = printToStd;
+    writeHeader(xres, yres);
+}
+
+PpmWriter::PpmWriter(ostream &out, int xres, int yres) {
+    this->out = &out;
+    printToStd = false;
+    writeHeader(xres, yres);
+}
+
+void PpmWriter::writeHeader(int xres, int yres) {
+    this->xres = xres;
+    row.resize(xres);
+
+    for (int x = 0; x < FB_TILE; x++) {
+        unfilledTile += UNFILLED_STR;
+    }
+
+    emit("P3\n" + to_string(xres) + " " + to_string(yres) + "\n255\n");
+}
+
+void PpmWriter::emit(const string &text) {
+    *out << text;
+    if (printToStd) {
+        cout << text;
+    }
+}
+
+/* Formats pixels [x0, x_end) of row onto line */
+static void appendPixels(const float *row, int x0, int x_end, string &line) {
+    color_rgb_t color = initColor(255, 255, 255);
+    for (int x = x0; x < x_end; x++) {
+        float fill = row[x];
+        if (fill == 0) {
+            line += UNFILLED_STR;
+        } else {
+            line += toString(scaleColor(color, fill));
+            line += '\n';
+        }
+    }
+}
+
+template <typename FormatRow>
+void PpmWriter::writeFormatted(int y0, int rows, FormatRow format) {
+    /* Formats one row at a time and writes it out in one go */
+    if (scheduler == nullptr) {
+        lines.resize(1);
+        for (int y = y0; y < y0 + rows; y++) {
+            lines[0].clear();
+            format(y, row.data(), lines[0]);
+            emit(lines[0]);
+        }
+        return;
+    }
+
+    /* Formats a block of rows in parallel, then writes them out in order */
+    const int BLOCK_ROWS = 256, TASK_ROWS = 16;
+    lines.resize(BLOCK_ROWS);
+    for (int b0 = y0; b0 < y0 + rows; b0 += BLOCK_ROWS) {
+        int b_end = min(b0 + BLOCK_ROWS, y0 + rows);
+        parallelFor(scheduler, b0, b_end, TASK_ROWS, [&](size_t lo, size_t hi) {
+            vector<float> scratch(xres);
+            for (size_t y = lo; y < hi; y++) {
+                lines[y - b0].clear();
+                format(y, scratch.data(), lines[y - b0]);
+            }
+        });
+        for (int y = b0; y < b_end; y++) {
+            emit(lines[y - b0]);
+        }
+    }
+}
+
+void PpmWriter::writeRows(const Framebuffer &fb, int y0, int rows) {
+    if (unfilledRow.empty()) {
+        for (int x = 0; x < xres; x++) {
+            unfilledRow += UNFILLED_STR;
+        }
+    }
+
+    writeFormatted(y0, rows, [&](int y, float *row, string &line) {
+        if (fb.rowEmpty(y)) {
+            line += unfilledRow;
+            return;
+        }
+        fb.readRow(y, row);
+        for (int x0 = 0; x0 < xres; x0 += FB_TILE) {
+            int x_end = min(x0 + FB_TILE, xres);
+            if (fb.tileEmpty(y, x0)) {
+                line.append(unfilledTile, 0, (x_end - x0) * UNFILLED_STR.size());
+                continue;
+            }
+            appendPixels(row, x0, x_end, line);
+        }
+    });
+}
+
+void PpmWriter::writeRows(const frame_view_t &view, int y0, int rows) {
+    /* Views are read in place, so the scratch row goes unused */
+    writeFormatted(y0, rows, [&](int y, float *, string &line) {
+        appendPixels(view.row(y), 0, xres, line);
+    });
+}
+
+void PpmWriter::close() {
+    if (ppm.is_open()) {
+        ppm.close();
+    }
+}
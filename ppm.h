@@ -0,0 +1,73 @@
+#ifndef PPM_H
+#define PPM_H
+
+#include <fstream>
+#include <string>
+#include <vector>
+#include "framebuffer.h"
+#include "scheduler.h"
+
+using namespace std;
+
+/**
+ * Streams a P3 PPM image to a file, and optionally to standard out,
+ * or to any other stream a band of rows at a time, shading white 
+ * lines on a black background.
+ */
+class PpmWriter {
+    public:
+        /* Pool rows are formatted on, if set; they're still written in order */
+        Scheduler *scheduler = nullptr;
+
+        /**
+         * Creates filename and writes the PPM header.
+         *
+         * @param printToStd, if true, everything is also printed to standard out
+         * @throws runtime_error if it fails to open the file
+         */
+        PpmWriter(string filename, int xres, int yres, bool printToStd);
+
+        /**
+         * Writes the PPM header to out, which the image is then written to.
+         */
+        PpmWriter(ostream &out, int xres, int yres);
+
+        /**
+         * Appends rows [y0, y0 + rows) of fb as the next rows of the image.
+         * Rows and tiles fb reports as never written are copied from
+         * ready-made runs of black pixels instead of being formatted.
+         */
+        void writeRows(const Framebuffer &fb, int y0, int rows);
+
+        /**
+         * Appends rows [y0, y0 + rows) of view as the next rows of the
+         * image, reading them in place.
+         */
+        void writeRows(const frame_view_t &view, int y0, int rows);
+
+        void close();
+
+    private:
+        ofstream ppm;
+        /* ppm, or the stream given in its place */
+        ostream *out;
+        bool printToStd;
+        int xres;
+        string unfilledTile, unfilledRow;
+        /* Reused text and shades of the rows being written */
+        vector<string> lines;
+        vector<float> row;
+
+        void writeHeader(int xres, int yres);
+        void emit(const string &text);
+
+        /**
+         * Calls format(y, row, line) for each row y in [y0, y0 + rows) to
+         * append its text to line, given row scratch for xres shades,
+         * then writes the lines out in order.
+         */
+        template <typename FormatRow>
+        void writeFormatted(int y0, int rows, FormatRow format);
+};
+
+#endif
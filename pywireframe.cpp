@@ -0,0 +1,399 @@
+/*
+ CPython extension exposing Renderer to Python as the pywireframe module.
+
+     import pywireframe
+     renderer = pywireframe.Renderer(ssaa=2)
+     frame = renderer.render(open("data/scene_cube1.txt").read(), 800, 800)
+     pixels = numpy.asarray(frame)    # height x width float32, no copy
+
+ Frames export the Renderer's own image through the buffer protocol, so
+ while any view of a frame is alive the Renderer refuses to render again
+ (as a bytearray refuses to resize). Renders drop the GIL, so separate
+ Renderers can run on separate Python threads at the same time.
+*/
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#include "renderer.h"
+#include "ppm.h"
+
+using namespace std;
+
+typedef struct {
+    PyObject_HEAD
+    MeshCache *cache;
+} MeshCacheObject;
+
+typedef struct {
+    PyObject_HEAD
+    Renderer *renderer;
+    MeshCacheObject *cache;
+    /* True while a thread is inside render */
+    bool busy;
+    /* Number of renders done; a Frame is current if it has the same */
+    long long generation;
+    /* Buffers of the current Frame still exported */
+    Py_ssize_t exports;
+} RendererObject;
+
+typedef struct {
+    PyObject_HEAD
+    RendererObject *renderer;
+    frame_view_t view;
+    long long generation;
+    Py_ssize_t shape[2];
+    Py_ssize_t strides[2];
+} FrameObject;
+
+static PyTypeObject MeshCacheType = {PyVarObject_HEAD_INIT(NULL, 0)};
+static PyTypeObject RendererType = {PyVarObject_HEAD_INIT(NULL, 0)};
+static PyTypeObject FrameType = {PyVarObject_HEAD_INIT(NULL, 0)};
+
+
+/* MeshCache */
+
+static int MeshCache_init(MeshCacheObject *self, PyObject *args, PyObject *kwds) {
+    static const char *kwlist[] = {"budget_mb", NULL};
+    double budget_mb = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|d", (char **) kwlist, &budget_mb)) {
+        return -1;
+    }
+    if (budget_mb < 0) {
+        PyErr_SetString(PyExc_ValueError, "budget_mb must not be negative");
+        return -1;
+    }
+    delete self->cache;
+    self->cache = new MeshCache((size_t) (budget_mb * (1 << 20)));
+    return 0;
+}
+
+static void MeshCache_dealloc(MeshCacheObject *self) {
+    delete self->cache;
+    Py_TYPE(self)->tp_free((PyObject *) self);
+}
+
+
+/* Renderer */
+
+/* Sets *out to the value of name in choices, or fails with ValueError */
+template <typename T>
+static bool parseChoice(const char *option, const char *name, T *out,
+                        const char *const names[], const T values[], int count) {
+    if (name == NULL) {
+        return true;
+    }
+    for (int i = 0; i < count; i++) {
+        if (string(name) == names[i]) {
+            *out = values[i];
+            return true;
+        }
+    }
+    PyErr_Format(PyExc_ValueError, "unknown %s '%s'", option, name);
+    return false;
+}
+
+static int Renderer_init(RendererObject *self, PyObject *args, PyObject *kwds) {
+    static const char *kwlist[] = {"cache", "mesh_dir", "ssaa", "filter", "line_width",
+                                   "sort_edges", "layout", "antialiase", "cull", "edges", "crease_angle",
+                                   "lod", NULL};
+    PyObject *cache = NULL;
+    const char *mesh_dir = "data/";
+    const char *filter = NULL, *sort_edges = NULL, *layout = NULL, *cull = NULL;
+    const char *edges = NULL;
+    render_options_t options;
+    int antialiase = 1;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|O!sizdzzpzzdd", (char **) kwlist,
+                                     &MeshCacheType, &cache, &mesh_dir, &options.ssaa,
+                                     &filter, &options.line_width, &sort_edges, &layout,
+                                     &antialiase, &cull, &edges, &options.crease_angle,
+                                     &options.lod_pixels)) {
+        return -1;
+    }
+    options.antialiase = antialiase;
+
+    static const char *const filter_names[] = {"box", "tent"};
+    static const ssaa_filter_t filters[] = {SSAA_BOX, SSAA_TENT};
+    static const char *const order_names[] = {"scene", "tile", "hilbert"};
+    static const edge_order_t orders[] = {EDGE_ORDER_SCENE, EDGE_ORDER_TILE, EDGE_ORDER_HILBERT};
+    static const char *const layout_names[] = {"rowmajor", "tiled", "sparse"};
+    static const fb_layout_t layouts[] = {FB_ROW_MAJOR, FB_TILED, FB_SPARSE};
+    static const char *const cull_names[] = {"none", "backface", "hidden"};
+    static const cull_mode_t cull_modes[] = {CULL_NONE, CULL_BACKFACE, CULL_HIDDEN};
+    static const char *const edge_names[] = {"all", "outline"};
+    static const edge_mode_t edge_modes[] = {EDGES_ALL, EDGES_OUTLINE};
+    if (!parseChoice("filter", filter, &options.ssaa_filter, filter_names, filters, 2) ||
+            !parseChoice("sort_edges", sort_edges, &options.edge_order, order_names, orders, 3) ||
+            !parseChoice("layout", layout, &options.fb_layout, layout_names, layouts, 3) ||
+            !parseChoice("cull", cull, &options.cull_mode, cull_names, cull_modes, 3) ||
+            !parseChoice("edges", edges, &options.edge_mode, edge_names, edge_modes, 2)) {
+        return -1;
+    }
+
+    if (self->renderer != NULL) {
+        PyErr_SetString(PyExc_RuntimeError, "Renderer is already initialized");
+        return -1;
+    }
+    if (cache == NULL) {
+        cache = PyObject_CallNoArgs((PyObject *) &MeshCacheType);
+        if (cache == NULL) {
+            return -1;
+        }
+    } else {
+        Py_INCREF(cache);
+    }
+    self->cache = (MeshCacheObject *) cache;
+    self->renderer = new Renderer(*self->cache->cache, mesh_dir);
+    self->renderer->options = options;
+    return 0;
+}
+
+static void Renderer_dealloc(RendererObject *self) {
+    delete self->renderer;
+    Py_XDECREF(self->cache);
+    Py_TYPE(self)->tp_free((PyObject *) self);
+}
+
+static PyObject *Renderer_render(RendererObject *self, PyObject *args, PyObject *kwds) {
+    static const char *kwlist[] = {"scene", "width", "height", NULL};
+    const char *text;
+    Py_ssize_t text_size;
+    int width, height;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "s#ii", (char **) kwlist,
+                                     &text, &text_size, &width, &height)) {
+        return NULL;
+    }
+    if (self->renderer == NULL) {
+        PyErr_SetString(PyExc_RuntimeError, "Renderer is not initialized");
+        return NULL;
+    }
+    if (self->busy) {
+        PyErr_SetString(PyExc_RuntimeError,
+                        "Renderer is already rendering; use one Renderer per thread");
+        return NULL;
+    }
+    if (self->exports > 0) {
+        PyErr_SetString(PyExc_BufferError,
+                        "the last frame is still viewed; release its views or copy it first");
+        return NULL;
+    }
+
+    FrameObject *frame = PyObject_New(FrameObject, &FrameType);
+    if (frame == NULL) {
+        return NULL;
+    }
+    frame->renderer = NULL;
+
+    string scene(text, text_size);
+    string error;
+    bool bad_argument = false;
+    /* Older frames go stale before their pixels start changing */
+    self->generation++;
+    self->busy = true;
+    Py_BEGIN_ALLOW_THREADS
+    try {
+        frame->view = self->renderer->render(scene, width, height);
+    } catch (const invalid_argument &e) {
+        error = e.what();
+        bad_argument = true;
+    } catch (const exception &e) {
+        error = e.what();
+    }
+    Py_END_ALLOW_THREADS
+    self->busy = false;
+
+    if (!error.empty()) {
+        Py_DECREF(frame);
+        PyErr_SetString(bad_argument ? PyExc_ValueError : PyExc_RuntimeError, error.c_str());
+        return NULL;
+    }
+    Py_INCREF(self);
+    frame->renderer = self;
+    frame->generation = self->generation;
+    frame->shape[0] = frame->view.height;
+    frame->shape[1] = frame->view.width;
+    frame->strides[0] = frame->view.stride * sizeof(float);
+    frame->strides[1] = sizeof(float);
+    return (PyObject *) frame;
+}
+
+static PyMethodDef Renderer_methods[] = {
+    {"render", (PyCFunction) (void (*)(void)) Renderer_render, METH_VARARGS | METH_KEYWORDS,
+     "render(scene, width, height) -> Frame\n\n"
+     "Renders the text of a scene description file at width by height."},
+    {NULL}
+};
+
+
+/* Frame */
+
+static void Frame_dealloc(FrameObject *self) {
+    Py_XDECREF(self->renderer);
+    Py_TYPE(self)->tp_free((PyObject *) self);
+}
+
+/* Fails with BufferError unless self still views its Renderer's image */
+static bool Frame_check(FrameObject *self) {
+    if (self->renderer->generation != self->generation) {
+        PyErr_SetString(PyExc_BufferError, "frame was replaced by a later render");
+        return false;
+    }
+    return true;
+}
+
+static int Frame_getbuffer(FrameObject *self, Py_buffer *view, int flags) {
+    if (!Frame_check(self)) {
+        view->obj = NULL;
+        return -1;
+    }
+    if (flags & PyBUF_WRITABLE) {
+        PyErr_SetString(PyExc_BufferError, "frames are read-only");
+        view->obj = NULL;
+        return -1;
+    }
+
+    const frame_view_t &v = self->view;
+    /* Padded rows can only be described by strides, and never contiguously */
+    bool contiguous = (flags & PyBUF_C_CONTIGUOUS) == PyBUF_C_CONTIGUOUS ||
+                      (flags & PyBUF_F_CONTIGUOUS) == PyBUF_F_CONTIGUOUS ||
+                      (flags & PyBUF_ANY_CONTIGUOUS) == PyBUF_ANY_CONTIGUOUS;
+    if (v.stride != (size_t) v.width && (contiguous || (flags & PyBUF_STRIDES) != PyBUF_STRIDES)) {
+        PyErr_SetString(PyExc_BufferError,
+                        "frame rows are padded; request a strided, non-contiguous buffer");
+        view->obj = NULL;
+        return -1;
+    }
+    if ((flags & PyBUF_F_CONTIGUOUS) == PyBUF_F_CONTIGUOUS && 
+            (flags & PyBUF_ANY_CONTIGUOUS) != PyBUF_ANY_CONTIGUOUS &&
+            v.width > 1 && v.height > 1) {
+        PyErr_SetString(PyExc_BufferError, "frames are row-major, not Fortran contiguous");
+        view->obj = NULL;
+        return -1;
+    }
+
+    view->buf = (void *) v.pixels;
+    view->obj = (PyObject *) self;
+    Py_INCREF(self);
+    view->len = (Py_ssize_t) v.height * v.width * sizeof(float);
+    view->readonly = 1;
+    view->itemsize = sizeof(float);
+    view->format = (flags & PyBUF_FORMAT) ? (char *) "f" : NULL;
+    /* A PyBUF_SIMPLE request gets the pixels as one flat run of bytes */
+    view->ndim = (flags & PyBUF_ND) ? 2 : 1;
+    view->shape = (flags & PyBUF_ND) ? self->shape : NULL;
+    view->strides = (flags & PyBUF_STRIDES) == PyBUF_STRIDES ? self->strides : NULL;
+    view->suboffsets = NULL;
+    view->internal = NULL;
+    self->renderer->exports++;
+    return 0;
+}
+
+static void Frame_releasebuffer(FrameObject *self, Py_buffer *) {
+    self->renderer->exports--;
+}
+
+static PyObject *Frame_ppm(FrameObject *self, PyObject *) {
+    if (!Frame_check(self)) {
+        return NULL;
+    }
+    ostringstream out;
+    PpmWriter writer(out, self->view.width, self->view.height);
+    writer.writeRows(self->view, 0, self->view.height);
+    string text = out.str();
+    return PyBytes_FromStringAndSize(text.data(), text.size());
+}
+
+static PyObject *Frame_get_width(FrameObject *self, void *) {
+    return PyLong_FromLong(self->view.width);
+}
+
+static PyObject *Frame_get_height(FrameObject *self, void *) {
+    return PyLong_FromLong(self->view.height);
+}
+
+static PyObject *Frame_get_stride(FrameObject *self, void *) {
+    return PyLong_FromSize_t(self->view.stride);
+}
+
+static PyObject *Frame_get_format(FrameObject *, void *) {
+    return PyUnicode_FromString("gray_f32");
+}
+
+static PyBufferProcs Frame_as_buffer = {
+    (getbufferproc) Frame_getbuffer,
+    (releasebufferproc) Frame_releasebuffer,
+};
+
+static PyMethodDef Frame_methods[] = {
+    {"ppm", (PyCFunction) Frame_ppm, METH_NOARGS,
+     "ppm() -> bytes\n\nEncodes the frame as the P3 PPM ./wireframe writes."},
+    {NULL}
+};
+
+static PyGetSetDef Frame_getset[] = {
+    {"width", (getter) Frame_get_width, NULL, "pixels per row", NULL},
+    {"height", (getter) Frame_get_height, NULL, "rows", NULL},
+    {"stride", (getter) Frame_get_stride, NULL, "pixels from one row to the next", NULL},
+    {"format", (getter) Frame_get_format, NULL, "pixel format, one float32 shade per pixel", NULL},
+    {NULL}
+};
+
+
+/* Module */
+
+static PyModuleDef pywireframe_module = {
+    PyModuleDef_HEAD_INIT, "pywireframe",
+    "Renders wireframe scenes into frames numpy can view without copying.", -1,
+};
+
+PyMODINIT_FUNC PyInit_pywireframe(void) {
+    MeshCacheType.tp_name = "pywireframe.MeshCache";
+    MeshCacheType.tp_basicsize = sizeof(MeshCacheObject);
+    MeshCacheType.tp_flags = Py_TPFLAGS_DEFAULT;
+    MeshCacheType.tp_doc = "MeshCache(budget_mb=0)\n\n"
+                           "Parsed .obj files shared by the Renderers given it.";
+    MeshCacheType.tp_new = PyType_GenericNew;
+    MeshCacheType.tp_init = (initproc) MeshCache_init;
+    MeshCacheType.tp_dealloc = (destructor) MeshCache_dealloc;
+
+    RendererType.tp_name = "pywireframe.Renderer";
+    RendererType.tp_basicsize = sizeof(RendererObject);
+    RendererType.tp_flags = Py_TPFLAGS_DEFAULT;
+    RendererType.tp_doc = "Renderer(cache=None, mesh_dir='data/', ssaa=1, filter='box',\n"
+                          "         line_width=1.0, sort_edges='scene', layout='rowmajor',\n"
+                          "         antialiase=True, cull='none', edges='all',\n"
+                          "         crease_angle=45.0, lod=0.0)";
+    RendererType.tp_new = PyType_GenericNew;
+    RendererType.tp_init = (initproc) Renderer_init;
+    RendererType.tp_dealloc = (destructor) Renderer_dealloc;
+    RendererType.tp_methods = Renderer_methods;
+
+    FrameType.tp_name = "pywireframe.Frame";
+    FrameType.tp_basicsize = sizeof(FrameObject);
+    FrameType.tp_flags = Py_TPFLAGS_DEFAULT;
+    FrameType.tp_doc = "Read-only view of a Renderer's last image, through the buffer protocol.";
+    FrameType.tp_dealloc = (destructor) Frame_dealloc;
+    FrameType.tp_as_buffer = &Frame_as_buffer;
+    FrameType.tp_methods = Frame_methods;
+    FrameType.tp_getset = Frame_getset;
+
+    if (PyType_Ready(&MeshCacheType) < 0 || PyType_Ready(&RendererType) < 0 ||
+            PyType_Ready(&FrameType) < 0) {
+        return NULL;
+    }
+
+    PyObject *module = PyModule_Create(&pywireframe_module);
+    if (module == NULL) {
+        return NULL;
+    }
+    if (PyModule_AddObjectRef(module, "MeshCache", (PyObject *) &MeshCacheType) < 0 ||
+            PyModule_AddObjectRef(module, "Renderer", (PyObject *) &RendererType) < 0 ||
+            PyModule_AddObjectRef(module, "Frame", (PyObject *) &FrameType) < 0) {
+        Py_DECREF(module);
+        return NULL;
+    }
+    return module;
+}
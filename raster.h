@@ -0,0 +1,133 @@
+#ifndef RASTER_H
+#define RASTER_H
+
+#include <cstdlib>
+#include "object.h"
+
+/**
+ * Walks the Bresenham line between v1 and v2 and calls plot(y, x, shade)
+ * for each of its points whose row lies in [row0, row_end), in the same
+ * order and with the same rounding and shades as
+ * Wireframe::bresenhamRasterize.
+ *
+ * With antialiase, each inner point is split between itself and its
+ * neighbor across the line, which may lie one row or column outside the
+ * window; plot is responsible for clipping, and callers wanting every
+ * write to a row range should widen the window by one row on each side.
+ *
+ * Rather than stepping from the first vertex, the walk starts directly at
+ * the first point inside the row window using the closed form of the
+ * Bresenham error term, so a line split across many windows costs no more
+ * than drawing it once. All error arithmetic is done in 64-bit.
+ */
+template <typename PlotFn>
+void walkLineRows(grid_vertex_t v1, grid_vertex_t v2, long long row0,
+                  long long row_end, bool antialiase, PlotFn plot) {
+    // Same vertex ordering as bresenhamRasterize: lower has the smaller x
+    grid_vertex_t lower = v2, upper = v1;
+    if (v1.x < v2.x) {
+        lower = v1;
+        upper = v2;
+    }
+
+    long long dx = (long long) upper.x - lower.x;
+    long long dy = (long long) upper.y - lower.y;
+    long long step_y = (dy < 0) ? -1 : 1;
+    long long ady = llabs(dy);
+    // Absolute slope, rounded to float as bresenhamRasterize does
+    float slope = ady * 1.0 / dx;
+
+    if (dx >= ady) {
+        /*
+         Mild slope: x_k = lower.x + k, y_k = lower.y + step_y * b_k
+         where b_k = floor((2k * ady + dx) / (2dx)) is the rounded offset.
+         First finds the bounds [t_lo, t_hi] on b_k that keep y_k in the window,
+         then the smallest k reaching each bound.
+        */
+        long long t_lo, t_hi;
+        if (step_y > 0) {
+            t_lo = row0 - lower.y;
+            t_hi = row_end - 1 - lower.y;
+        } else {
+            t_lo = lower.y - row_end + 1;
+            t_hi = lower.y - row0;
+        }
+        if (t_hi < 0 || t_lo > ady) {
+            return;
+        }
+        auto first_k = [&](long long t) -> long long {
+            if (t <= 0) {
+                return 0;
+            }
+            long long num = (2 * t - 1) * dx;
+            return (num + 2 * ady - 1) / (2 * ady);
+        };
+        long long k = first_k(t_lo);
+        long long k_end = (t_hi >= ady) ? dx + 1 : first_k(t_hi + 1);
+        if (k_end > dx + 1) {
+            k_end = dx + 1;
+        }
+
+        long long b = (dx == 0) ? 0 : (2 * k * ady + dx) / (2 * dx);
+        long long eps_d = k * ady - b * dx;
+        for (; k < k_end; k++) {
+            long long y = lower.y + step_y * b;
+            long long x = lower.x + k;
+            if (antialiase && k != 0 && k != dx) {
+                long long base = lower.y + b;
+                float float_base = base + slope;
+                float intensity = float_base - base;
+                plot(y, x, 1.0 - intensity);
+                plot(y + step_y, x, intensity);
+            } else {
+                plot(y, x, 1);
+            }
+            eps_d += ady;
+            if ((eps_d << 1) >= dx) {
+                b++;
+                eps_d -= dx;
+            }
+        }
+    } else {
+        /*
+         Steep slope: y_k = lower.y + step_y * k, x_k = lower.x + b_k
+         where b_k = floor((2k * dx + ady) / (2ady)). k maps directly to rows.
+        */
+        long long k, k_last;
+        if (step_y > 0) {
+            k = row0 - lower.y;
+            k_last = row_end - 1 - lower.y;
+        } else {
+            k = lower.y - row_end + 1;
+            k_last = lower.y - row0;
+        }
+        if (k < 0) {
+            k = 0;
+        }
+        if (k_last > ady) {
+            k_last = ady;
+        }
+
+        long long b = (2 * k * dx + ady) / (2 * ady);
+        long long eps_d = k * dx - b * ady;
+        for (; k <= k_last; k++) {
+            long long y = lower.y + step_y * k;
+            long long x = lower.x + b;
+            if (antialiase && k != 0 && k != ady) {
+                float float_base = x + 1.0 / slope;
+                float intensity = float_base - x;
+                plot(y, x, 1.0 - intensity);
+                plot(y, x + 1, intensity);
+            } else {
+                plot(y, x, 1);
+            }
+            eps_d += dx;
+            if ((eps_d << 1) >= ady) {
+                b++;
+                eps_d -= ady;
+            }
+        }
+    }
+}
+
+#endif
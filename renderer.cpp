@@ -0,0 +1,82 @@
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+
+#include "renderer.h"
+
+Renderer::Renderer(MeshCache &meshes, string mesh_dir, Scheduler *scheduler) {
+    pipeline.mesh_cache = &meshes;
+    pipeline.mesh_dir = mesh_dir;
+    pipeline.scheduler = scheduler;
+}
+
+Renderer::~Renderer() {
+    pipeline.destruct();
+}
+
+void Renderer::render(const string &scene, const image_buffer_t &image) {
+    if (image.pixels == nullptr || image.stride < (size_t) image.width) {
+        throw invalid_argument("Image buffer needs pixels and "
+                               "a stride of at least its width.");
+    }
+
+    /* A row-major grid is drawn straight into image; the tiled layouts
+       are drawn into the pipeline's own grid and copied out in rows */
+    if (options.fb_layout == FB_ROW_MAJOR) {
+        pipeline.target_pixels = image.pixels;
+        pipeline.target_stride = image.stride;
+        try {
+            render(scene, image.width, image.height);
+        } catch (...) {
+            pipeline.target_pixels = nullptr;
+            throw;
+        }
+        pipeline.target_pixels = nullptr;
+        return;
+    }
+    frame_view_t view = render(scene, image.width, image.height);
+
+    Stopwatch watch;
+    for (int y = 0; y < image.height; y++) {
+        copy(view.row(y), view.row(y) + view.width, image.pixels + y * image.stride);
+    }
+    pipeline.stats.addTime("copy out", watch.elapsedMs());
+    stats = pipeline.stats;
+}
+
+frame_view_t Renderer::render(const string &scene, int width, int height) {
+    if (width <= 0 || height <= 0) {
+        throw invalid_argument("Images need positive dimensions.");
+    }
+    if (options.ssaa < 1 || options.ssaa > MAX_SSAA_FACTOR || options.line_width <= 0) {
+        throw invalid_argument("Render options need ssaa in [1, " +
+                               to_string(MAX_SSAA_FACTOR) + "] and a positive line_width.");
+    }
+
+    pipeline.clearScene();
+    pipeline.xres = width;
+    pipeline.yres = height;
+    pipeline.ssaa = options.ssaa;
+    pipeline.ssaa_filter = options.ssaa_filter;
+    pipeline.line_width = options.line_width;
+    pipeline.edge_order = options.edge_order;
+    pipeline.cull_mode = options.cull_mode;
+    pipeline.edge_mode = options.edge_mode;
+    pipeline.crease_angle = options.crease_angle;
+    pipeline.lod_pixels = options.lod_pixels;
+    pipeline.fb_layout = options.fb_layout;
+    pipeline.stats = RenderStats();
+    pipeline.stats.enabled = options.stats;
+
+    istringstream text(scene);
+    pipeline.processFormat(text);
+    pipeline.computeTransforms();
+    pipeline.applyTransforms();
+    pipeline.plot(options.antialiase);
+
+    Stopwatch watch;
+    frame_view_t view = pipeline.view();
+    pipeline.stats.addTime("view", watch.elapsedMs());
+    stats = pipeline.stats;
+    return view;
+}
@@ -0,0 +1,97 @@
+#ifndef RENDERER_H
+#define RENDERER_H
+
+#include <cstddef>
+#include <string>
+#include "wireframe.h"
+#include "meshcache.h"
+#include "stats.h"
+
+using namespace std;
+
+/* Caller-owned image a Renderer draws into: height rows of width shades
+   in [0, 1], each row starting stride floats after the one before */
+typedef struct imageBuffer {
+    float *pixels;
+    int width;
+    int height;
+    size_t stride;
+} image_buffer_t;
+
+/* How a Renderer draws, each option meaning the same as the
+   Wireframe property of the same name */
+typedef struct renderOptions {
+    int ssaa = 1;
+    ssaa_filter_t ssaa_filter = SSAA_BOX;
+    double line_width = 1;
+    edge_order_t edge_order = EDGE_ORDER_SCENE;
+    cull_mode_t cull_mode = CULL_NONE;
+    edge_mode_t edge_mode = EDGES_ALL;
+    double crease_angle = 45;
+    double lod_pixels = 0;
+    fb_layout_t fb_layout = FB_ROW_MAJOR;
+    /* Antialiases lines when not supersampling */
+    bool antialiase = true;
+    /* Records timings and counters into Renderer::stats */
+    bool stats = false;
+} render_options_t;
+
+/**
+ * Entry point of libwireframe for embedding the pipeline in another
+ * program: construct it once, then call render as often as needed.
+ *
+ * A Renderer reads and writes no files itself. Scenes are passed in as
+ * text, images are written into a buffer the caller owns, and the .obj
+ * files scenes name are acquired from the MeshCache the caller supplies.
+ * It keeps no global state: separate Renderers may render on separate
+ * threads at the same time, sharing one MeshCache if they like, but a
+ * single Renderer must not be used by two threads at once.
+ */
+class Renderer {
+    public:
+        render_options_t options;
+        /* Timings and counters of the last render, if options.stats */
+        RenderStats stats;
+
+        /**
+         * @param meshes cache the .obj files named by scenes come from
+         * @param mesh_dir folder those .obj file names are relative to
+         * @param scheduler pool to render on, which may be shared with 
+         *                  other Renderers, or nullptr to render serially
+         */
+        Renderer(MeshCache &meshes, string mesh_dir = "data/", 
+                 Scheduler *scheduler = nullptr);
+        ~Renderer();
+
+        Renderer(const Renderer &) = delete;
+        Renderer &operator=(const Renderer &) = delete;
+
+        /**
+         * Renders scene, the contents of a format .txt file, into image
+         * at image.width by image.height. With options.fb_layout
+         * FB_ROW_MAJOR lines are drawn straight into image, leaving the
+         * padding between its rows as it is; the tiled layouts draw into
+         * buffers of the Renderer's own, kept between calls, and copy out.
+         *
+         * @throws invalid_argument if image or options aren't usable, or
+         *         if scene can't be parsed or names an .obj file that
+         *         can't be read
+         */
+        void render(const string &scene, const image_buffer_t &image);
+
+        /**
+         * Renders scene at width by height and returns a read-only view
+         * of the Renderer's own image, copying nothing when
+         * options.fb_layout is FB_ROW_MAJOR (see Wireframe::view). 
+         * The view stays valid until the next render or the Renderer's
+         * destruction.
+         *
+         * @throws invalid_argument as the other render
+         */
+        frame_view_t render(const string &scene, int width, int height);
+
+    private:
+        Wireframe pipeline;
+};
+
+#endif
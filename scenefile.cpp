@@ -0,0 +1,93 @@
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "scenefile.h"
+
+/* True if count items of item_size bytes at offset, aligned to align,
+   fit in a file of size bytes */
+static bool fits(uint64_t offset, uint64_t count, size_t item_size, size_t align, size_t size) {
+    return offset % align == 0 && offset <= size && count <= (size - offset) / item_size;
+}
+
+SceneFile::SceneFile(const string &filename) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw invalid_argument("Could not read scene file '" + filename + "'.");
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size < (off_t) sizeof(scene_header_t)) {
+        close(fd);
+        throw invalid_argument("Scene file '" + filename + "' is too short.");
+    }
+    size = info.st_size;
+    void *mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        throw invalid_argument("Could not map scene file '" + filename + "'.");
+    }
+    data = (const char *) mapped;
+
+    const scene_header_t &h = header();
+    if (memcmp(h.magic, SCENE_MAGIC, sizeof(SCENE_MAGIC)) != 0 ||
+            !fits(h.meshes_offset, h.mesh_count, sizeof(scene_mesh_t), 8, size) ||
+            !fits(h.mesh_ids_offset, h.instance_count, sizeof(uint32_t), 4, size) ||
+            !fits(h.matrices_offset, h.instance_count, sizeof(scene_matrix_t), 8, size)) {
+        munmap((void *) data, size);
+        throw invalid_argument("File '" + filename + "' is not a binary scene file.");
+    }
+}
+
+SceneFile::~SceneFile() {
+    munmap((void *) data, size);
+}
+
+const scene_header_t &SceneFile::header() const {
+    return *(const scene_header_t *) data;
+}
+
+const scene_mesh_t *SceneFile::meshes() const {
+    return (const scene_mesh_t *) (data + header().meshes_offset);
+}
+
+const uint32_t *SceneFile::meshIds() const {
+    return (const uint32_t *) (data + header().mesh_ids_offset);
+}
+
+const scene_matrix_t *SceneFile::matrices() const {
+    return (const scene_matrix_t *) (data + header().matrices_offset);
+}
+
+void SceneFile::write(const string &filename, scene_header_t header,
+                      const vector<scene_mesh_t> &meshes,
+                      const vector<uint32_t> &mesh_ids,
+                      const vector<scene_matrix_t> &matrices) {
+    memcpy(header.magic, SCENE_MAGIC, sizeof(SCENE_MAGIC));
+    header.mesh_count = meshes.size();
+    header.reserved = 0;
+    header.instance_count = mesh_ids.size();
+    header.meshes_offset = sizeof(scene_header_t);
+    header.mesh_ids_offset = header.meshes_offset + meshes.size() * sizeof(scene_mesh_t);
+    /* Pads the indexes so the matrices after them are 8-byte aligned */
+    size_t ids_bytes = mesh_ids.size() * sizeof(uint32_t);
+    size_t padding = (8 - ids_bytes % 8) % 8;
+    header.matrices_offset = header.mesh_ids_offset + ids_bytes + padding;
+
+    ofstream file(filename, ios::binary | ios::trunc);
+    if (file.fail()) {
+        throw invalid_argument("Could not write scene file '" + filename + "'.");
+    }
+    const char zeros[8] = {0};
+    file.write((const char *) &header, sizeof(header));
+    file.write((const char *) meshes.data(), meshes.size() * sizeof(scene_mesh_t));
+    file.write((const char *) mesh_ids.data(), ids_bytes);
+    file.write(zeros, padding);
+    file.write((const char *) matrices.data(), matrices.size() * sizeof(scene_matrix_t));
+    if (file.fail()) {
+        throw invalid_argument("Could not write scene file '" + filename + "'.");
+    }
+}
@@ -0,0 +1,95 @@
+#ifndef SCENEFILE_H
+#define SCENEFILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/* First bytes of every binary scene file */
+const char SCENE_MAGIC[8] = {'W', 'F', 'S', 'C', 'E', 'N', 'E', '1'};
+
+/* Sizes, NUL included, of the mesh names and .obj file names a binary
+   scene file can hold */
+const int SCENE_NAME_SIZE = 64;
+const int SCENE_FILE_SIZE = 192;
+
+/* Start of a binary scene file, giving where each of its arrays starts */
+typedef struct scene_header {
+    char magic[8];
+    uint32_t mesh_count;
+    uint32_t reserved;
+    uint64_t instance_count;
+    /* Camera position, and orientation as an axis and angle */
+    double position[3];
+    double orientation[4];
+    /* Near, far, left, right, top and bottom of the frustum */
+    double perspective[6];
+    /* Byte offsets of the mesh table, mesh indexes and matrices */
+    uint64_t meshes_offset;
+    uint64_t mesh_ids_offset;
+    uint64_t matrices_offset;
+} scene_header_t;
+
+/* Object of a binary scene: its name and its .obj file, relative to the
+   mesh folder, empty for an object with no mesh */
+typedef struct scene_mesh {
+    char name[SCENE_NAME_SIZE];
+    char file[SCENE_FILE_SIZE];
+} scene_mesh_t;
+
+/* Top three rows, row by row, of an instance's scene transform; the
+   bottom row is always 0 0 0 1 */
+typedef struct scene_matrix {
+    double rows[12];
+} scene_matrix_t;
+
+/**
+ * Read-only memory mapping of a binary scene file, the counterpart of a
+ * scene .txt file for scenes exported by tools.
+ *
+ * The file is a scene_header_t followed by mesh_count scene_mesh_t, then
+ * instance_count uint32_t indexes into the mesh table and instance_count
+ * scene_matrix_t, one per copy, in the byte order of the machine that
+ * wrote it. Opening it maps the file and checks the header, so takes the
+ * same time however many instances it holds; the arrays are read in place.
+ */
+class SceneFile {
+    public:
+        /**
+         * Maps the binary scene file at filename.
+         *
+         * @throws invalid_argument if it can't be read or its header
+         *         doesn't describe a binary scene of its size
+         */
+        SceneFile(const string &filename);
+        ~SceneFile();
+
+        SceneFile(const SceneFile &) = delete;
+        SceneFile &operator=(const SceneFile &) = delete;
+
+        const scene_header_t &header() const;
+        const scene_mesh_t *meshes() const;
+        const uint32_t *meshIds() const;
+        const scene_matrix_t *matrices() const;
+
+        /**
+         * Writes a binary scene file at filename holding header's camera
+         * and perspective with the given arrays, filling in the rest of
+         * the header.
+         *
+         * @throws invalid_argument if the file can't be written
+         */
+        static void write(const string &filename, scene_header_t header,
+                          const vector<scene_mesh_t> &meshes,
+                          const vector<uint32_t> &mesh_ids,
+                          const vector<scene_matrix_t> &matrices);
+
+    private:
+        const char *data = nullptr;
+        size_t size = 0;
+};
+
+#endif
@@ -0,0 +1,230 @@
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "scheduler.h"
+
+/* Binds t to the index-th CPU this process may run on */
+static void pinThread(thread &t, int index) {
+#ifdef __linux__
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0 || CPU_COUNT(&allowed) == 0) {
+        return;
+    }
+    int target = index % CPU_COUNT(&allowed);
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &allowed) && target-- == 0) {
+            cpu_set_t one;
+            CPU_ZERO(&one);
+            CPU_SET(cpu, &one);
+            pthread_setaffinity_np(t.native_handle(), sizeof(one), &one);
+            return;
+        }
+    }
+#endif
+}
+
+Scheduler::Scheduler(int threads, bool pin, bool deterministic)
+    : steals(0), next_queue(0) {
+    this->deterministic = deterministic;
+    threads = max(threads, 1);
+    for (int i = 0; i < threads; i++) {
+        queues.push_back(unique_ptr<worker_queue_t>(new worker_queue_t));
+    }
+    for (int i = 0; i < threads; i++) {
+        workers.push_back(thread(&Scheduler::workerLoop, this, i));
+        if (pin) {
+            pinThread(workers.back(), i);
+        }
+    }
+}
+
+Scheduler::~Scheduler() {
+    {
+        lock_guard<mutex> guard(sleep_lock);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (size_t i = 0; i < workers.size(); i++) {
+        workers[i].join();
+    }
+}
+
+int Scheduler::threads() const {
+    return workers.size();
+}
+
+int Scheduler::workerIndex() const {
+    thread::id me = this_thread::get_id();
+    for (size_t i = 0; i < workers.size(); i++) {
+        if (workers[i].get_id() == me) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void Scheduler::submit(task_t task, int queue) {
+    if (queue < 0) {
+        queue = workerIndex();
+    }
+    if (queue < 0) {
+        queue = next_queue++ % queues.size();
+    }
+    {
+        lock_guard<mutex> guard(queues[queue]->lock);
+        queues[queue]->tasks.push_back(move(task));
+    }
+    /* Taking sleep_lock orders this after any sleeper's last check */
+    lock_guard<mutex> guard(sleep_lock);
+    wake.notify_all();
+}
+
+bool Scheduler::take(int self, task_t &task) {
+    if (self >= 0) {
+        worker_queue_t &own = *queues[self];
+        lock_guard<mutex> guard(own.lock);
+        if (!own.tasks.empty()) {
+            if (deterministic) {
+                task = move(own.tasks.front());
+                own.tasks.pop_front();
+            } else {
+                task = move(own.tasks.back());
+                own.tasks.pop_back();
+            }
+            return true;
+        }
+    }
+    if (deterministic) {
+        return false;
+    }
+
+    size_t n = queues.size();
+    size_t start = (self >= 0) ? self + 1 : 0;
+    for (size_t k = 0; k < n; k++) {
+        size_t victim = (start + k) % n;
+        if ((int) victim == self) {
+            continue;
+        }
+        worker_queue_t &other = *queues[victim];
+        lock_guard<mutex> guard(other.lock);
+        if (!other.tasks.empty()) {
+            task = move(other.tasks.front());
+            other.tasks.pop_front();
+            steals++;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Scheduler::hasWork(int self) {
+    for (size_t i = 0; i < queues.size(); i++) {
+        if (deterministic && (int) i != self) {
+            continue;
+        }
+        lock_guard<mutex> guard(queues[i]->lock);
+        if (!queues[i]->tasks.empty()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void Scheduler::run(task_t &task) {
+    exception_ptr thrown;
+    try {
+        task.fn();
+    } catch (...) {
+        thrown = current_exception();
+    }
+    task.group->finish(thrown);
+}
+
+void Scheduler::workerLoop(int index) {
+    task_t task;
+    while (true) {
+        if (take(index, task)) {
+            run(task);
+            continue;
+        }
+        unique_lock<mutex> guard(sleep_lock);
+        wake.wait(guard, [&]() { return stopping || hasWork(index); });
+        if (stopping && !hasWork(index)) {
+            return;
+        }
+    }
+}
+
+TaskGroup::TaskGroup(Scheduler *scheduler) : pending(0) {
+    this->scheduler = scheduler;
+}
+
+TaskGroup::~TaskGroup() {
+    try {
+        wait();
+    } catch (...) {
+    }
+}
+
+void TaskGroup::run(function<void()> fn) {
+    if (scheduler == nullptr) {
+        exception_ptr thrown;
+        try {
+            fn();
+        } catch (...) {
+            thrown = current_exception();
+        }
+        pending++;
+        finish(thrown);
+        return;
+    }
+
+    pending++;
+    int queue = -1;
+    if (scheduler->deterministic) {
+        queue = submitted % scheduler->queues.size();
+    }
+    submitted++;
+    scheduler->submit({move(fn), this}, queue);
+}
+
+void TaskGroup::finish(exception_ptr thrown) {
+    if (thrown) {
+        lock_guard<mutex> guard(error_lock);
+        if (!error) {
+            error = thrown;
+        }
+    }
+    /* The group may be destroyed by its waiter as soon as pending is 0 */
+    Scheduler *pool = scheduler;
+    if (--pending == 0 && pool != nullptr) {
+        lock_guard<mutex> guard(pool->sleep_lock);
+        pool->wake.notify_all();
+    }
+}
+
+void TaskGroup::wait() {
+    if (scheduler != nullptr) {
+        int self = scheduler->workerIndex();
+        Scheduler::task_t task;
+        while (pending > 0) {
+            if (scheduler->take(self, task)) {
+                scheduler->run(task);
+                continue;
+            }
+            unique_lock<mutex> guard(scheduler->sleep_lock);
+            scheduler->wake.wait(guard, [&]() {
+                return pending == 0 || scheduler->hasWork(self);
+            });
+        }
+    }
+
+    lock_guard<mutex> guard(error_lock);
+    if (error) {
+        exception_ptr thrown = error;
+        error = nullptr;
+        rethrow_exception(thrown);
+    }
+}
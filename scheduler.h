@@ -0,0 +1,173 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+class TaskGroup;
+
+/**
+ * Work-stealing thread pool shared by every parallel stage, so stages
+ * submit work to it instead of starting threads of their own.
+ *
+ * Each worker has its own deque of tasks. A worker submits to the back
+ * of its own deque and takes from the back (newest first, so nested work
+ * stays in cache); an idle worker steals from the front of the others'.
+ * Threads that aren't workers hand their tasks out round robin, and
+ * while waiting on a TaskGroup any thread runs queued tasks rather than
+ * block, so tasks may wait on tasks of their own.
+ *
+ * In deterministic mode nothing is stolen: the n-th task of a group
+ * always goes to worker n % threads, which runs its deque in order.
+ * The pipeline's output never depends on scheduling; this mode also
+ * fixes which worker does what, for reproducible timings and debugging.
+ */
+class Scheduler {
+    public:
+        /* Tasks run by a worker other than the one they were queued on */
+        atomic<long long> steals;
+
+        /**
+         * Starts threads workers.
+         *
+         * @param pin, if true, binds worker i to the i-th CPU this process
+         *             may run on (wrapping around)
+         * @param deterministic, if true, disables stealing as described above
+         */
+        Scheduler(int threads, bool pin = false, bool deterministic = false);
+
+        /**
+         * Finishes every queued task, then stops the workers.
+         */
+        ~Scheduler();
+
+        Scheduler(const Scheduler &) = delete;
+        Scheduler &operator=(const Scheduler &) = delete;
+
+        int threads() const;
+
+    private:
+        friend class TaskGroup;
+
+        typedef struct task {
+            function<void()> fn;
+            TaskGroup *group;
+        } task_t;
+
+        /* Deque of one worker */
+        typedef struct workerQueue {
+            mutex lock;
+            deque<task_t> tasks;
+        } worker_queue_t;
+
+        bool deterministic;
+        vector<unique_ptr<worker_queue_t>> queues;
+        vector<thread> workers;
+        /* Next queue a thread that isn't a worker submits to */
+        atomic<size_t> next_queue;
+
+        /* Sleeping workers and waiters wait on wake under sleep_lock */
+        mutex sleep_lock;
+        condition_variable wake;
+        bool stopping = false;
+
+        /* Returns the calling thread's worker index, or -1 */
+        int workerIndex() const;
+
+        /* Queues task on queue, or by the rules above if queue is -1 */
+        void submit(task_t task, int queue);
+
+        /* Takes a task self may run, returning false if there is none */
+        bool take(int self, task_t &task);
+
+        /* Returns true if self could take a task. Called under sleep_lock */
+        bool hasWork(int self);
+
+        /* Runs task, then reports it done to its group */
+        void run(task_t &task);
+
+        void workerLoop(int index);
+};
+
+/**
+ * Tasks submitted together and waited for together. Tasks may run their
+ * own TaskGroups. With a null Scheduler tasks run immediately on the
+ * calling thread, so stages can share one code path for serial runs.
+ */
+class TaskGroup {
+    public:
+        TaskGroup(Scheduler *scheduler);
+
+        /**
+         * Waits for every task, dropping any exception they threw.
+         */
+        ~TaskGroup();
+
+        TaskGroup(const TaskGroup &) = delete;
+        TaskGroup &operator=(const TaskGroup &) = delete;
+
+        /**
+         * Queues fn to run on the scheduler. Only one thread may queue
+         * tasks on a group; tasks that split further use groups of their own.
+         */
+        void run(function<void()> fn);
+
+        /**
+         * Returns once every task has finished, running queued tasks in
+         * the meantime.
+         *
+         * @throws the first exception a task threw, if any
+         */
+        void wait();
+
+    private:
+        friend class Scheduler;
+
+        Scheduler *scheduler;
+        atomic<long> pending;
+        /* Tasks submitted so far, used to place them in deterministic mode */
+        size_t submitted = 0;
+        mutex error_lock;
+        exception_ptr error;
+
+        /* Called by the scheduler as each task ends */
+        void finish(exception_ptr thrown);
+};
+
+/**
+ * Calls body(lo, hi) over consecutive ranges covering [begin, end) of at
+ * least grain items each, in parallel on scheduler if it isn't null.
+ * Ranges are the same however many threads there are, so body may keep
+ * per-range scratch data.
+ *
+ * @throws the first exception body threw, if any
+ */
+template <typename Body>
+void parallelFor(Scheduler *scheduler, size_t begin, size_t end, size_t grain, Body body) {
+    if (end <= begin) {
+        return;
+    }
+    grain = max(grain, (size_t) 1);
+    if (scheduler == nullptr || end - begin <= grain) {
+        body(begin, end);
+        return;
+    }
+    TaskGroup group(scheduler);
+    for (size_t lo = begin; lo < end; lo += grain) {
+        size_t hi = min(lo + grain, end);
+        group.run([&body, lo, hi]() { body(lo, hi); });
+    }
+    group.wait();
+}
+
+#endif
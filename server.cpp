@@ -0,0 +1,332 @@
+#include <cerrno>
+#include <csignal>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "utils.h"
+#include "ppm.h"
+#include "server.h"
+
+/* Largest scene description and image a request may ask for */
+static const long long MAX_SCENE_BYTES = 1 << 24;
+static const long long MAX_REQUEST_PIXELS = 1 << 26;
+/* Longest request line accepted */
+static const size_t MAX_LINE_BYTES = 1024;
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void requestStop(int) {
+    stop_requested = 1;
+}
+
+/* Writes all of text to fd, returning false if the client went away */
+static bool sendAll(int fd, const string &text) {
+    size_t sent = 0;
+    while (sent < text.size()) {
+        ssize_t n = send(fd, text.data() + sent, text.size() - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        sent += n;
+    }
+    return true;
+}
+
+/* Buffered reads of requests from a connection */
+class RequestReader {
+    public:
+        RequestReader(int fd) : fd(fd) {}
+
+        /* Reads up to the next newline, returning false at end of input */
+        bool readLine(string &line) {
+            size_t end;
+            while ((end = pending.find('\n')) == string::npos) {
+                if (pending.size() > MAX_LINE_BYTES || !fill()) {
+                    return false;
+                }
+            }
+            line = pending.substr(0, end);
+            pending.erase(0, end + 1);
+            return true;
+        }
+
+        /* Reads exactly n bytes, returning false if input ends first */
+        bool readBytes(size_t n, string &out) {
+            while (pending.size() < n) {
+                if (!fill()) {
+                    return false;
+                }
+            }
+            out = pending.substr(0, n);
+            pending.erase(0, n);
+            return true;
+        }
+
+    private:
+        int fd;
+        string pending;
+
+        bool fill() {
+            char chunk[65536];
+            ssize_t n;
+            do {
+                n = recv(fd, chunk, sizeof(chunk), 0);
+            } while (n < 0 && errno == EINTR);
+            if (n <= 0) {
+                return false;
+            }
+            pending.append(chunk, n);
+            return true;
+        }
+};
+
+ConnectionQueue::ConnectionQueue(size_t capacity) {
+    this->capacity = capacity;
+}
+
+bool ConnectionQueue::push(int fd) {
+    {
+        lock_guard<mutex> guard(lock);
+        if (closed || fds.size() >= capacity) {
+            return false;
+        }
+        fds.push_back(fd);
+    }
+    ready.notify_one();
+    return true;
+}
+
+int ConnectionQueue::pop() {
+    unique_lock<mutex> guard(lock);
+    ready.wait(guard, [&]() { return closed || !fds.empty(); });
+    if (fds.empty()) {
+        return -1;
+    }
+    int fd = fds.front();
+    fds.pop_front();
+    return fd;
+}
+
+void ConnectionQueue::close() {
+    {
+        lock_guard<mutex> guard(lock);
+        closed = true;
+    }
+    ready.notify_all();
+}
+
+RenderServer::RenderServer(const render_options_t &options, int threads, int queue_size,
+                           size_t mesh_budget, Scheduler *scheduler)
+    : options(options), threads(threads), scheduler(scheduler), queue(queue_size), 
+      cache(mesh_budget) {
+    stats.enabled = options.stats;
+}
+
+void RenderServer::serve(const string &socket_path) {
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(addr.sun_path)) {
+        throw runtime_error("Socket path '" + socket_path + "' is too long.");
+    }
+    socket_path.copy(addr.sun_path, socket_path.size());
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) {
+        throw runtime_error("Could not create a socket.");
+    }
+    unlink(socket_path.c_str());
+    if (bind(listener, (sockaddr *) &addr, sizeof(addr)) < 0 || listen(listener, 128) < 0) {
+        ::close(listener);
+        throw runtime_error("Could not listen on '" + socket_path + "'.");
+    }
+
+    /*
+     Keeps SIGINT and SIGTERM blocked everywhere except inside ppoll below,
+     so they always interrupt the accept loop and never a worker. Threads
+     started before this, like the scheduler's, were blocked by the caller.
+    */
+    struct sigaction on_stop = {}, old_int, old_term;
+    on_stop.sa_handler = requestStop;
+    sigemptyset(&on_stop.sa_mask);
+    sigaction(SIGINT, &on_stop, &old_int);
+    sigaction(SIGTERM, &on_stop, &old_term);
+    sigset_t stop_signals, old_mask, wait_mask;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, &old_mask);
+    wait_mask = old_mask;
+    sigdelset(&wait_mask, SIGINT);
+    sigdelset(&wait_mask, SIGTERM);
+    stop_requested = 0;
+
+    vector<thread> pool;
+    for (int t = 0; t < threads; t++) {
+        pool.push_back(thread(&RenderServer::work, this));
+    }
+
+    pollfd listening = {listener, POLLIN, 0};
+    while (!stop_requested) {
+        if (ppoll(&listening, 1, nullptr, &wait_mask) <= 0) {
+            continue;
+        }
+        int fd = accept(listener, nullptr, nullptr);
+        if (fd < 0) {
+            continue;
+        }
+        if (!queue.push(fd)) {
+            sendAll(fd, "ERROR server busy\n");
+            ::close(fd);
+            lock_guard<mutex> guard(stats_lock);
+            rejected++;
+        }
+    }
+
+    ::close(listener);
+    unlink(socket_path.c_str());
+    queue.close();
+    {
+        /* Lets idle connections end; requests being rendered still finish */
+        lock_guard<mutex> guard(stats_lock);
+        stopping = true;
+        for (int fd : active) {
+            shutdown(fd, SHUT_RD);
+        }
+    }
+    for (size_t t = 0; t < pool.size(); t++) {
+        pool[t].join();
+    }
+    pthread_sigmask(SIG_SETMASK, &old_mask, nullptr);
+    sigaction(SIGINT, &old_int, nullptr);
+    sigaction(SIGTERM, &old_term, nullptr);
+
+    if (stats.enabled) {
+        stats.addCount("requests", requests);
+        stats.addCount("failed requests", failed);
+        stats.addCount("rejected connections", rejected);
+        stats.addCount("worker threads", threads);
+        stats.addCount("mesh cache hits", cache.hits);
+        stats.addCount("mesh cache misses", cache.misses);
+        stats.addCount("mesh cache evictions", cache.evictions);
+        stats.addCount("mesh cache bytes", cache.resident_bytes);
+    }
+}
+
+void RenderServer::work() {
+    Renderer renderer(cache, "data/", scheduler);
+    renderer.options = options;
+    int fd;
+    while ((fd = queue.pop()) >= 0) {
+        {
+            lock_guard<mutex> guard(stats_lock);
+            active.insert(fd);
+            if (stopping) {
+                shutdown(fd, SHUT_RD);
+            }
+        }
+        serveConnection(fd, renderer);
+        {
+            lock_guard<mutex> guard(stats_lock);
+            active.erase(fd);
+        }
+        ::close(fd);
+    }
+}
+
+void RenderServer::serveConnection(int fd, Renderer &renderer) {
+    RequestReader reader(fd);
+    string header, text, ppm;
+    vector<string> words;
+
+    while (reader.readLine(header)) {
+        words.clear();
+        splitBySpace(header, words);
+        int xres, yres;
+        long long length;
+        try {
+            if (words.size() != 4 || words[0] != "RENDER") {
+                throw invalid_argument("expected RENDER xres yres length");
+            }
+            xres = stoi(words[1]);
+            yres = stoi(words[2]);
+            length = stoll(words[3]);
+        } catch (const logic_error &e) {
+            sendAll(fd, "ERROR malformed request\n");
+            return;
+        }
+        if (length < 0 || length > MAX_SCENE_BYTES) {
+            sendAll(fd, "ERROR scene description too large\n");
+            return;
+        }
+        if (!reader.readBytes(length, text)) {
+            return;
+        }
+
+        string error;
+        if (xres <= 0 || yres <= 0 || (long long) xres * yres > MAX_REQUEST_PIXELS) {
+            error = "xres, yres must be positive and at most " +
+                    to_string(MAX_REQUEST_PIXELS) + " pixels in all";
+        } else {
+            try {
+                render(renderer, text, xres, yres, ppm);
+            } catch (const char *msg) {
+                error = msg;
+            } catch (const exception &e) {
+                error = e.what();
+            }
+        }
+
+        {
+            lock_guard<mutex> guard(stats_lock);
+            requests++;
+            if (!error.empty()) {
+                failed++;
+            }
+        }
+        bool sent;
+        if (error.empty()) {
+            sent = sendAll(fd, "OK " + to_string(ppm.size()) + "\n") && sendAll(fd, ppm);
+        } else {
+            sent = sendAll(fd, "ERROR " + error + "\n");
+        }
+        if (!sent) {
+            return;
+        }
+    }
+}
+
+void RenderServer::render(Renderer &renderer, const string &text, int xres, int yres,
+                          string &ppm) {
+    frame_view_t view = renderer.render(text, xres, yres);
+
+    Stopwatch watch;
+    ostringstream out;
+    PpmWriter writer(out, xres, yres);
+    writer.scheduler = scheduler;
+    writer.writeRows(view, 0, yres);
+    ppm = out.str();
+    double encode_ms = watch.elapsedMs();
+
+    lock_guard<mutex> guard(stats_lock);
+    for (size_t t = 0; t < renderer.stats.times.size(); t++) {
+        stats.addTime(renderer.stats.times[t].first, renderer.stats.times[t].second);
+    }
+    stats.addTime("encode", encode_ms);
+}
+
+void blockStopSignals() {
+    sigset_t stop_signals;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, nullptr);
+}
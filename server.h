@@ -0,0 +1,127 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <string>
+#include "renderer.h"
+#include "meshcache.h"
+#include "stats.h"
+
+using namespace std;
+
+/**
+ * Connections accepted by the server and waiting for a worker.
+ * Holds at most capacity of them so a burst of clients is turned away
+ * instead of queueing without bound.
+ */
+class ConnectionQueue {
+    public:
+        ConnectionQueue(size_t capacity);
+
+        /**
+         * Adds the connection fd. Returns false, leaving fd to the caller,
+         * if the queue is full or closed.
+         */
+        bool push(int fd);
+
+        /**
+         * Takes the oldest connection, waiting for one if none are queued.
+         * Returns -1 once the queue is closed and empty.
+         */
+        int pop();
+
+        /**
+         * Wakes every waiting pop; connections already queued are still
+         * handed out.
+         */
+        void close();
+
+    private:
+        size_t capacity;
+        bool closed = false;
+        deque<int> fds;
+        mutex lock;
+        condition_variable ready;
+};
+
+/**
+ * Render daemon listening on a Unix domain socket.
+ *
+ * Meshes stay resident in one MeshCache across requests, so a request
+ * costs a scene parse and a render but no process start-up or .obj
+ * parsing. Each connection can send any number of requests:
+ *
+ *     RENDER xres yres length\n<length bytes of a format .txt file>
+ *
+ * each answered with
+ *
+ *     OK length\n<length bytes of PPM image>   or   ERROR message\n
+ *
+ * Connections wait in a bounded ConnectionQueue for one of a pool of
+ * worker threads, which serves them until the client hangs up. Each
+ * worker renders with its own Renderer and encodes straight from its view;
+ * the stages of those renders run on the Scheduler, if one is given.
+ */
+class RenderServer {
+    public:
+        /**
+         * @param options every request is rendered with
+         * @param threads number of connections served at once
+         * @param queue_size number of connections that may wait for a worker
+         * @param mesh_budget bytes of meshes kept resident, 0 for no limit
+         * @param scheduler pool the workers' Renderers render on, if set
+         */
+        RenderServer(const render_options_t &options, int threads, int queue_size,
+                     size_t mesh_budget, Scheduler *scheduler = nullptr);
+
+        /**
+         * Listens on socket_path, replacing any stale socket there, and
+         * serves clients until SIGINT or SIGTERM, then finishes the
+         * requests in flight and removes the socket. Threads started
+         * before it, such as the scheduler's, must have the two signals
+         * blocked (see blockStopSignals) for serve to be sure to see them.
+         *
+         * @throws runtime_error if it fails to create the socket
+         */
+        void serve(const string &socket_path);
+
+        /* Timings summed over all requests, and request counters */
+        RenderStats stats;
+
+    private:
+        render_options_t options;
+        int threads;
+        Scheduler *scheduler;
+        ConnectionQueue queue;
+        MeshCache cache;
+
+        /* Guards stats and active */
+        mutex stats_lock;
+        long long requests = 0, failed = 0, rejected = 0;
+        /* Connections being served, shut down when the server stops */
+        set<int> active;
+        bool stopping = false;
+
+        void work();
+        void serveConnection(int fd, Renderer &renderer);
+
+        /**
+         * Renders the scene in text at xres by yres into ppm.
+         * @throws exception if the scene can't be rendered
+         */
+        void render(Renderer &renderer, const string &text, int xres, int yres,
+                    string &ppm);
+};
+
+/**
+ * Blocks SIGINT and SIGTERM in the calling thread, and so in every thread
+ * it starts from then on. Call before starting threads that run while
+ * RenderServer::serve does, so that only serve's wait for connections
+ * takes the signals.
+ */
+void blockStopSignals();
+
+#endif
@@ -0,0 +1,293 @@
+#include <algorithm>
+#include <cmath>
+#include <queue>
+#include <Eigen/Dense>
+
+#include "simplify.h"
+
+using Eigen::Matrix4d;
+using Eigen::Vector3d;
+using Eigen::Vector4d;
+
+/* How much more moving a border costs than moving off a face's plane */
+static const double BORDER_WEIGHT = 10;
+
+/* Candidate collapse of edge (u, v) into u; stale once either vertex
+   has changed since it was queued */
+typedef struct collapse {
+    double cost;
+    int u;
+    int v;
+    int u_version;
+    int v_version;
+
+    bool operator>(const struct collapse &other) const {
+        return cost > other.cost;
+    }
+} collapse_t;
+
+/* State of a mesh being simplified */
+typedef struct simplifier {
+    vector<Vector3d> points;
+    vector<Matrix4d> quadrics;
+    vector<int> versions;
+    vector<bool> vertex_alive;
+    /* Faces around each vertex, possibly including dead ones */
+    vector<vector<int>> vertex_faces;
+    vector<face_t> faces;
+    vector<bool> face_alive;
+    size_t live_faces;
+    priority_queue<collapse_t, vector<collapse_t>, greater<collapse_t>> queue;
+} simplifier_t;
+
+/* Quadric of the squared distance to the plane through point with unit normal */
+static Matrix4d planeQuadric(const Vector3d &normal, const Vector3d &point) {
+    Vector4d plane(normal[0], normal[1], normal[2], -normal.dot(point));
+    return plane * plane.transpose();
+}
+
+static Vector3d faceNormal(const Vector3d &a, const Vector3d &b, const Vector3d &c) {
+    return (b - a).cross(c - a);
+}
+
+static double quadricCost(const Matrix4d &q, const Vector3d &p) {
+    Vector4d v(p[0], p[1], p[2], 1);
+    return max(0.0, (double) (v.transpose() * q * v));
+}
+
+/* Point to merge u and v at: the one on the edge minimizing their summed
+   quadric, or the best of the two ends and the midpoint if the quadric is
+   flat along the edge. Staying on the edge keeps every level of detail
+   inside the full mesh's hull, and so inside its bounding sphere. Sets cost
+   to the quadric there */
+static Vector3d collapsePoint(const simplifier_t &s, int u, int v, double &cost) {
+    Matrix4d q = s.quadrics[u] + s.quadrics[v];
+    Vector3d a = s.points[u], b = s.points[v];
+    Vector3d point = a;
+    cost = quadricCost(q, a);
+    for (const Vector3d &p : {b, Vector3d((a + b) / 2)}) {
+        if (quadricCost(q, p) < cost) {
+            cost = quadricCost(q, p);
+            point = p;
+        }
+    }
+    /* The quadric along a + t (b - a) is a parabola in t */
+    Vector4d start(a[0], a[1], a[2], 1), step(b[0] - a[0], b[1] - a[1], b[2] - a[2], 0);
+    double curve = step.transpose() * q * step, slope = step.transpose() * q * start;
+    if (curve > 1e-12) {
+        Vector3d best = a + min(1.0, max(0.0, -slope / curve)) * (b - a);
+        if (quadricCost(q, best) < cost) {
+            cost = quadricCost(q, best);
+            point = best;
+        }
+    }
+    return point;
+}
+
+static void queueCollapse(simplifier_t &s, int u, int v) {
+    double cost;
+    collapsePoint(s, u, v, cost);
+    s.queue.push({cost, u, v, s.versions[u], s.versions[v]});
+}
+
+/* Live vertexes sharing a live face with u */
+static vector<int> neighbors(const simplifier_t &s, int u) {
+    vector<int> found;
+    for (int f : s.vertex_faces[u]) {
+        if (!s.face_alive[f]) {
+            continue;
+        }
+        for (int w : {s.faces[f].v1, s.faces[f].v2, s.faces[f].v3}) {
+            if (w != u) {
+                found.push_back(w);
+            }
+        }
+    }
+    sort(found.begin(), found.end());
+    found.erase(unique(found.begin(), found.end()), found.end());
+    return found;
+}
+
+/* True if moving u and v to point keeps the surface as it was: the faces
+   left don't flip over and (u, v) shares no neighbor but the far corners
+   of its own faces */
+static bool collapseAllowed(const simplifier_t &s, int u, int v, const Vector3d &point) {
+    int shared_faces = 0;
+    for (int moved : {u, v}) {
+        for (int f : s.vertex_faces[moved]) {
+            if (!s.face_alive[f]) {
+                continue;
+            }
+            int idx[3] = {s.faces[f].v1, s.faces[f].v2, s.faces[f].v3};
+            bool has_u = false, has_v = false;
+            for (int k = 0; k < 3; k++) {
+                has_u |= idx[k] == u;
+                has_v |= idx[k] == v;
+            }
+            if (has_u && has_v) {
+                shared_faces += (moved == u);
+                continue;
+            }
+            Vector3d before[3], after[3];
+            for (int k = 0; k < 3; k++) {
+                before[k] = s.points[idx[k]];
+                after[k] = (idx[k] == moved) ? point : before[k];
+            }
+            Vector3d old_normal = faceNormal(before[0], before[1], before[2]);
+            Vector3d new_normal = faceNormal(after[0], after[1], after[2]);
+            if (new_normal.dot(old_normal) <= 0) {
+                return false;
+            }
+        }
+    }
+
+    vector<int> around_u = neighbors(s, u), around_v = neighbors(s, v);
+    vector<int> common;
+    set_intersection(around_u.begin(), around_u.end(), around_v.begin(), around_v.end(),
+                     back_inserter(common));
+    return (int) common.size() <= shared_faces;
+}
+
+/* Merges v into u at point */
+static void collapseEdge(simplifier_t &s, int u, int v, const Vector3d &point) {
+    s.points[u] = point;
+    s.quadrics[u] += s.quadrics[v];
+    s.versions[u]++;
+    s.vertex_alive[v] = false;
+
+    for (int f : s.vertex_faces[v]) {
+        if (!s.face_alive[f]) {
+            continue;
+        }
+        face_t &face = s.faces[f];
+        if (face.v1 == u || face.v2 == u || face.v3 == u) {
+            s.face_alive[f] = false;
+            s.live_faces--;
+            continue;
+        }
+        if (face.v1 == v) {
+            face.v1 = u;
+        } else if (face.v2 == v) {
+            face.v2 = u;
+        } else {
+            face.v3 = u;
+        }
+        s.vertex_faces[u].push_back(f);
+    }
+    vector<int> &around = s.vertex_faces[u];
+    around.erase(remove_if(around.begin(), around.end(),
+                           [&](int f) { return !s.face_alive[f]; }), around.end());
+    s.vertex_faces[v].clear();
+
+    for (int w : neighbors(s, u)) {
+        queueCollapse(s, u, w);
+    }
+}
+
+/* Copies the live faces of s, and the vertexes they use, into a new mesh */
+static shared_ptr<const Object> snapshot(const simplifier_t &s, const string &name) {
+    shared_ptr<Object> level = make_shared<Object>();
+    level->name = name;
+    vector<int> renumbered(s.points.size(), 0);
+    for (size_t f = 0; f < s.faces.size(); f++) {
+        if (!s.face_alive[f]) {
+            continue;
+        }
+        int idx[3] = {s.faces[f].v1, s.faces[f].v2, s.faces[f].v3};
+        for (int k = 0; k < 3; k++) {
+            if (renumbered[idx[k]] == 0) {
+                renumbered[idx[k]] = level->vertexes.size();
+                const Vector3d &p = s.points[idx[k]];
+                level->vertexes.push_back(initVertex(p[0], p[1], p[2]));
+            }
+        }
+        level->faces.push_back(initFace(renumbered[idx[0]], renumbered[idx[1]],
+                                        renumbered[idx[2]]));
+    }
+    level->computeTopology();
+    return level;
+}
+
+void buildLods(Object &mesh) {
+    mesh.lods.clear();
+    if (mesh.faces.size() < 2 * LOD_MIN_FACES) {
+        return;
+    }
+
+    simplifier_t s;
+    size_t n = mesh.vertexes.size();
+    s.points.resize(n);
+    for (size_t i = 0; i < n; i++) {
+        s.points[i] = Vector3d(mesh.vertexes[i].x, mesh.vertexes[i].y, mesh.vertexes[i].z);
+    }
+    s.quadrics.assign(n, Matrix4d::Zero());
+    s.versions.assign(n, 0);
+    s.vertex_alive.assign(n, true);
+    s.vertex_faces.resize(n);
+    s.faces = mesh.faces;
+    s.face_alive.assign(mesh.faces.size(), true);
+    s.live_faces = mesh.faces.size();
+
+    for (size_t f = 0; f < s.faces.size(); f++) {
+        int idx[3] = {s.faces[f].v1, s.faces[f].v2, s.faces[f].v3};
+        Vector3d normal = faceNormal(s.points[idx[0]], s.points[idx[1]], s.points[idx[2]]);
+        if (normal.norm() > 0) {
+            Matrix4d plane = planeQuadric(normal.normalized(), s.points[idx[0]]);
+            for (int k = 0; k < 3; k++) {
+                s.quadrics[idx[k]] += plane;
+            }
+        }
+        for (int k = 0; k < 3; k++) {
+            s.vertex_faces[idx[k]].push_back(f);
+        }
+    }
+    /* Planes through each border edge, upright to its face */
+    for (const mesh_edge_t &edge : mesh.edges) {
+        if (edge.f2 >= 0) {
+            continue;
+        }
+        Vector3d a = s.points[edge.v1], b = s.points[edge.v2];
+        Vector3d face_normal(mesh.normals[edge.f1].x, mesh.normals[edge.f1].y,
+                             mesh.normals[edge.f1].z);
+        Vector3d normal = (b - a).cross(face_normal);
+        if (normal.norm() > 0) {
+            Matrix4d plane = BORDER_WEIGHT * planeQuadric(normal.normalized(), a);
+            s.quadrics[edge.v1] += plane;
+            s.quadrics[edge.v2] += plane;
+        }
+    }
+    for (const mesh_edge_t &edge : mesh.edges) {
+        queueCollapse(s, edge.v1, edge.v2);
+    }
+
+    double error = 0;
+    size_t target = mesh.faces.size() / 2;
+    size_t last_faces = mesh.faces.size();
+    while (target >= LOD_MIN_FACES) {
+        while (s.live_faces > target && !s.queue.empty()) {
+            collapse_t next = s.queue.top();
+            s.queue.pop();
+            if (!s.vertex_alive[next.u] || !s.vertex_alive[next.v] ||
+                    s.versions[next.u] != next.u_version || s.versions[next.v] != next.v_version) {
+                continue;
+            }
+            double cost;
+            Vector3d point = collapsePoint(s, next.u, next.v, cost);
+            if (!collapseAllowed(s, next.u, next.v, point)) {
+                continue;
+            }
+            error = max(error, sqrt(next.cost));
+            collapseEdge(s, next.u, next.v, point);
+        }
+        /* Stops once collapses run out without much change */
+        if (s.live_faces > last_faces * 9 / 10) {
+            break;
+        }
+        mesh.lods.push_back({snapshot(s, mesh.name), error});
+        last_faces = s.live_faces;
+        if (s.queue.empty()) {
+            break;
+        }
+        target = s.live_faces / 2;
+    }
+}
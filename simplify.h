@@ -0,0 +1,25 @@
+#ifndef SIMPLIFY_H
+#define SIMPLIFY_H
+
+#include <cstddef>
+#include "object.h"
+
+using namespace std;
+
+/* Fewest faces a level of detail is simplified down to */
+const size_t LOD_MIN_FACES = 64;
+
+/**
+ * Fills mesh.lods with simplified versions of mesh, each with about half
+ * the faces of the one before, until LOD_MIN_FACES or until no edge can
+ * be collapsed. mesh needs its edges (Object::computeTopology).
+ *
+ * Levels are made by collapsing the edge whose merged vertex lies nearest
+ * to the planes of the faces around it, the quadric error metric of
+ * Garland and Heckbert. The borders of open meshes are held in place by
+ * extra planes through them, and collapses that would fold a face over or
+ * pinch the surface are skipped.
+ */
+void buildLods(Object &mesh);
+
+#endif
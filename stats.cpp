@@ -0,0 +1,139 @@
+#include <cstring>
+#include <iomanip>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "stats.h"
+
+Stopwatch::Stopwatch() {
+    start = chrono::steady_clock::now();
+}
+
+double Stopwatch::elapsedMs() {
+    chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+CacheModel::CacheModel(size_t bytes, int ways, int line_bytes) {
+    this->ways = ways;
+    line_shift = 0;
+    while ((1 << line_shift) < line_bytes) {
+        line_shift++;
+    }
+    num_sets = bytes / line_bytes / ways;
+    tags.assign(num_sets * ways, UINT64_MAX);
+    stamps.assign(num_sets * ways, 0);
+}
+
+bool CacheModel::access(const void *addr) {
+    uint64_t line = (uint64_t) (uintptr_t) addr >> line_shift;
+    size_t set = line % num_sets;
+    uint64_t *set_tags = &tags[set * ways];
+    long long *set_stamps = &stamps[set * ways];
+
+    accesses++;
+    clock++;
+    int victim = 0;
+    for (int w = 0; w < ways; w++) {
+        if (set_tags[w] == line) {
+            set_stamps[w] = clock;
+            return true;
+        }
+        if (set_stamps[w] < set_stamps[victim]) {
+            victim = w;
+        }
+    }
+
+    misses++;
+    set_tags[victim] = line;
+    set_stamps[victim] = clock;
+    return false;
+}
+
+HardwareCounter::HardwareCounter() {
+    available = false;
+    fd = -1;
+#ifdef __linux__
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+    available = fd >= 0;
+#endif
+}
+
+HardwareCounter::~HardwareCounter() {
+#ifdef __linux__
+    if (fd >= 0) {
+        close(fd);
+    }
+#endif
+}
+
+void HardwareCounter::start() {
+#ifdef __linux__
+    if (available) {
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+}
+
+long long HardwareCounter::stop() {
+#ifdef __linux__
+    if (available) {
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        long long count;
+        if (read(fd, &count, sizeof(count)) == sizeof(count)) {
+            return count;
+        }
+    }
+#endif
+    return -1;
+}
+
+void RenderStats::addTime(const string &stage, double ms) {
+    for (size_t i = 0; i < times.size(); i++) {
+        if (times[i].first == stage) {
+            times[i].second += ms;
+            return;
+        }
+    }
+    times.push_back({stage, ms});
+}
+
+void RenderStats::addCount(const string &name, long long value) {
+    for (size_t i = 0; i < counters.size(); i++) {
+        if (counters[i].first == name) {
+            counters[i].second = value;
+            return;
+        }
+    }
+    counters.push_back({name, value});
+}
+
+void RenderStats::print(ostream &out) {
+    out << "stats:\n";
+    for (size_t i = 0; i < times.size(); i++) {
+        out << "  " << left << setw(36) << times[i].first
+            << fixed << setprecision(3) << times[i].second << " ms\n";
+    }
+    for (size_t i = 0; i < counters.size(); i++) {
+        out << "  " << left << setw(36) << counters[i].first;
+        if (counters[i].second < 0) {
+            out << "n/a\n";
+        } else {
+            out << counters[i].second << "\n";
+        }
+    }
+}
@@ -0,0 +1,113 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/**
+ * Measures wall-clock time from construction.
+ */
+class Stopwatch {
+    public:
+        Stopwatch();
+
+        /**
+         * Returns the milliseconds elapsed since construction.
+         */
+        double elapsedMs();
+
+    private:
+        chrono::steady_clock::time_point start;
+};
+
+/**
+ * Software model of one level of a set-associative LRU cache, fed with the
+ * addresses a stage writes. Gives a deterministic cache miss estimate on
+ * machines where hardware counters can't be read.
+ */
+class CacheModel {
+    public:
+        long long accesses = 0;
+        long long misses = 0;
+
+        /**
+         * @param bytes, total capacity of the modeled cache
+         * @param ways, associativity
+         * @param line_bytes, cache line size, a power of 2
+         */
+        CacheModel(size_t bytes, int ways, int line_bytes = 64);
+
+        /**
+         * Records an access to addr.
+         * @returns true on a hit, false on a miss
+         */
+        bool access(const void *addr);
+
+    private:
+        int ways;
+        int line_shift;
+        size_t num_sets;
+        long long clock = 0;
+        /* tags[set * ways + way] with the matching last-use time in stamps */
+        vector<uint64_t> tags;
+        vector<long long> stamps;
+};
+
+/**
+ * Counts the calling thread's hardware cache misses through perf_event_open;
+ * work handed to other threads isn't counted. Opening it costs a syscall,
+ * so construct one only when its count will be reported. If the counter
+ * can't be opened (non-Linux, no PMU, restricted perf), available is false
+ * and every count reads -1.
+ */
+class HardwareCounter {
+    public:
+        bool available;
+
+        HardwareCounter();
+        ~HardwareCounter();
+
+        void start();
+
+        /**
+         * Stops counting and returns the misses since start().
+         */
+        long long stop();
+
+    private:
+        int fd;
+};
+
+/**
+ * Timings and counters collected while rendering, printed by --stats.
+ */
+class RenderStats {
+    public:
+        /* If false, stages skip any costly instrumentation */
+        bool enabled = false;
+        /* If true, framebuffer writes also run through a CacheModel */
+        bool model_cache = false;
+        vector<pair<string, double>> times;
+        vector<pair<string, long long>> counters;
+
+        /**
+         * Records that stage took ms milliseconds, adding to the time of
+         * any earlier run of the same stage (e.g. in another frame).
+         */
+        void addTime(const string &stage, double ms);
+
+        /**
+         * Records a counter, -1 meaning it could not be measured.
+         * Replaces any earlier value of the same counter.
+         */
+        void addCount(const string &name, long long value);
+
+        void print(ostream &out);
+};
+
+#endif
@@ -0,0 +1,122 @@
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "raster.h"
+#include "supersample.h"
+
+void CoverageStrip::reset(int width, int row0, int rows) {
+    this->width = width;
+    this->row0 = row0;
+    this->rows = rows;
+    stride = (width + 15) & ~15;
+    cells.assign((size_t) stride * rows, 0);
+}
+
+void CoverageStrip::coverLine(grid_vertex_t v1, grid_vertex_t v2) {
+    uint8_t *base = cells.data();
+    int first_row = row0;
+    int row_stride = stride;
+    walkLineRows(v1, v2, row0, row0 + rows, false, [&](long long y, long long x, float) {
+        base[(y - first_row) * row_stride + x] = 1;
+    });
+}
+
+DownsampleFilter::DownsampleFilter(int factor, ssaa_filter_t type) {
+    if (factor < 1 || factor > MAX_SSAA_FACTOR) {
+        throw invalid_argument("Supersampling factor must be between 1 and " +
+                               to_string(MAX_SSAA_FACTOR) + ".");
+    }
+    this->factor = factor;
+
+    if (type == SSAA_BOX) {
+        lo = 0;
+        hi = factor - 1;
+        weights.assign(factor, 1);
+    } else {
+        /*
+         Tent of radius factor centered on the pixel center (x + 0.5) * factor.
+         Weights are doubled so even factors, whose center falls between
+         subsamples, still get integer weights: w(k) = 2N - |2k - (N - 1)|.
+        */
+        lo = 1;
+        hi = -1;
+        weights.clear();
+        for (int k = -factor; k <= 2 * factor; k++) {
+            int w = 2 * factor - abs(2 * k - (factor - 1));
+            if (w <= 0) {
+                continue;
+            }
+            if (lo > hi) {
+                lo = k;
+            }
+            hi = k;
+            weights.push_back(w);
+        }
+    }
+
+    uint32_t sum = 0;
+    for (size_t i = 0; i < weights.size(); i++) {
+        sum += weights[i];
+    }
+    norm = sum * sum;
+}
+
+/* acc[i] += weight * row[i] for one row of the strip */
+static void accumulateRow(const uint8_t *row, uint16_t weight,
+                          uint16_t *acc, int stride) {
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i w = _mm_set1_epi16(weight);
+    for (int i = 0; i < stride; i += 16) {
+        __m128i cover = _mm_loadu_si128((const __m128i *) (row + i));
+        __m128i acc_lo = _mm_loadu_si128((const __m128i *) (acc + i));
+        __m128i acc_hi = _mm_loadu_si128((const __m128i *) (acc + i + 8));
+        acc_lo = _mm_add_epi16(acc_lo, _mm_mullo_epi16(_mm_unpacklo_epi8(cover, zero), w));
+        acc_hi = _mm_add_epi16(acc_hi, _mm_mullo_epi16(_mm_unpackhi_epi8(cover, zero), w));
+        _mm_storeu_si128((__m128i *) (acc + i), acc_lo);
+        _mm_storeu_si128((__m128i *) (acc + i + 8), acc_hi);
+    }
+#else
+    for (int i = 0; i < stride; i++) {
+        acc[i] += weight * row[i];
+    }
+#endif
+}
+
+void downsampleStrip(const CoverageStrip &strip, const DownsampleFilter &filter,
+                     int out_y0, int out_rows, Framebuffer &grid) {
+    int factor = filter.factor;
+    vector<uint16_t> acc(strip.stride);
+    float inv_norm = 1.0f / filter.norm;
+
+    for (int y = out_y0; y < out_y0 + out_rows; y++) {
+        /* Vertical pass: weighted sum of the subsample rows under row y */
+        memset(acc.data(), 0, acc.size() * sizeof(uint16_t));
+        for (int k = filter.lo; k <= filter.hi; k++) {
+            int row = y * factor + k;
+            if (row < strip.row0 || row >= strip.row0 + strip.rows) {
+                continue;
+            }
+            accumulateRow(&strip.cells[(size_t) (row - strip.row0) * strip.stride],
+                          filter.weights[k - filter.lo], acc.data(), strip.stride);
+        }
+
+        /* Horizontal pass: weighted sum of the column sums under each pixel */
+        for (int x = 0; x < grid.width; x++) {
+            uint32_t sum = 0;
+            int first = x * factor + filter.lo;
+            for (int k = 0; k < (int) filter.weights.size(); k++) {
+                int col = first + k;
+                if (col >= 0 && col < strip.width) {
+                    sum += (uint32_t) filter.weights[k] * acc[col];
+                }
+            }
+            grid.set(y, x, sum * inv_norm);
+        }
+    }
+}
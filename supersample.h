@@ -0,0 +1,76 @@
+#ifndef SUPERSAMPLE_H
+#define SUPERSAMPLE_H
+
+#include <cstdint>
+#include <vector>
+#include "object.h"
+#include "framebuffer.h"
+
+using namespace std;
+
+/* Largest supported supersampling factor per axis */
+const int MAX_SSAA_FACTOR = 16;
+
+typedef enum ssaaFilter {
+    SSAA_BOX,
+    SSAA_TENT
+} ssaa_filter_t;
+
+/**
+ * Compact coverage buffer holding one horizontal strip of the
+ * supersampled image, one byte per subsample (0 empty, 1 covered).
+ */
+class CoverageStrip {
+    public:
+        /* Width of the supersampled image in subsamples */
+        int width;
+        /* First supersampled row held by the strip and its row count */
+        int row0, rows;
+        /* Row-major subsample coverage, padded to a multiple of 16 per row */
+        int stride;
+        vector<uint8_t> cells;
+
+        /**
+         * Resizes and clears the strip to hold rows [row0, row0 + rows).
+         */
+        void reset(int width, int row0, int rows);
+
+        /**
+         * Marks the subsamples covered by the Bresenham line between v1 and v2,
+         * touching only the rows held by the strip.
+         *
+         * Produces the same pixels as Wireframe::bresenhamRasterize does
+         * without antialiasing.
+         */
+        void coverLine(grid_vertex_t v1, grid_vertex_t v2);
+};
+
+/**
+ * Separable integer filter used to reduce a factor x factor block of
+ * subsamples (plus overlap for the tent) to one output pixel.
+ */
+class DownsampleFilter {
+    public:
+        int factor;
+        /* Subsample offsets [lo, hi] relative to x * factor covered by a pixel */
+        int lo, hi;
+        /* weights[k - lo] is the 1D weight of offset k */
+        vector<uint16_t> weights;
+        /* Sum of 2D weights, i.e. (sum of 1D weights)^2 */
+        uint32_t norm;
+
+        DownsampleFilter(int factor, ssaa_filter_t type);
+};
+
+/**
+ * Filters the coverage strip down to output rows [out_y0, out_y0 + out_rows),
+ * writing shades in [0, 1] into grid. The vertical pass, which does the
+ * bulk of the work, is vectorized with SSE2 when available.
+ *
+ * @param strip, must hold every subsample row the filter reads for those rows
+ *               (rows outside the supersampled image are treated as empty)
+ */
+void downsampleStrip(const CoverageStrip &strip, const DownsampleFilter &filter,
+                     int out_y0, int out_rows, Framebuffer &grid);
+
+#endif
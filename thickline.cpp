@@ -0,0 +1,77 @@
+#include <cmath>
+
+#include "thickline.h"
+
+void SpanBuffer::reset(int width, int row0, int rows) {
+    this->width = width;
+    this->row0 = row0;
+    this->rows = rows;
+    if ((int) spans.size() < rows) {
+        spans.resize(rows);
+    }
+    for (int r = 0; r < rows; r++) {
+        spans[r].clear();
+    }
+}
+
+void SpanBuffer::addSpan(int y, double x_lo, double x_hi) {
+    // Covers the pixels whose centers lie in [x_lo, x_hi)
+    int x0 = (int) ceil(x_lo);
+    int x1 = (int) ceil(x_hi);
+    if (x0 < x1 && x1 > 0 && x0 < width) {
+        spans[y - row0].push_back({x0, x1});
+    }
+}
+
+void SpanBuffer::addSegment(grid_vertex_t a, grid_vertex_t b, double half_width) {
+    double dx = b.x - a.x;
+    double dy = b.y - a.y;
+    double len = sqrt(dx * dx + dy * dy);
+    if (len == 0) {
+        return;
+    }
+
+    // Offset from the line to the rectangle's long sides
+    double nx = -dy / len * half_width;
+    double ny = dx / len * half_width;
+    double cx[4] = {a.x + nx, b.x + nx, b.x - nx, a.x - nx};
+    double cy[4] = {a.y + ny, b.y + ny, b.y - ny, a.y - ny};
+
+    double y_min = min(min(cy[0], cy[1]), min(cy[2], cy[3]));
+    double y_max = max(max(cy[0], cy[1]), max(cy[2], cy[3]));
+    int first = max((int) ceil(y_min), row0);
+    int last = min((int) ceil(y_max), row0 + rows) - 1;
+
+    for (int y = first; y <= last; y++) {
+        // Intersects the scanline with each side of the convex quad
+        double x_lo = INFINITY, x_hi = -INFINITY;
+        for (int i = 0; i < 4; i++) {
+            int j = (i + 1) % 4;
+            if ((y < cy[i]) == (y < cy[j])) {
+                continue;
+            }
+            double x = cx[i] + (y - cy[i]) * (cx[j] - cx[i]) / (cy[j] - cy[i]);
+            x_lo = min(x_lo, x);
+            x_hi = max(x_hi, x);
+        }
+        if (x_lo <= x_hi) {
+            addSpan(y, x_lo, x_hi);
+        }
+    }
+}
+
+void SpanBuffer::addDisc(grid_vertex_t c, double radius) {
+    int reach = (int) ceil(radius);
+    int first = max(c.y - reach, row0);
+    int last = min(c.y + reach, row0 + rows - 1);
+
+    for (int y = first; y <= last; y++) {
+        double dy = y - c.y;
+        double h = radius * radius - dy * dy;
+        if (h <= 0) {
+            continue;
+        }
+        h = sqrt(h);
+        addSpan(y, c.x - h, c.x + h);
+    }
+}
@@ -0,0 +1,80 @@
+#ifndef THICKLINE_H
+#define THICKLINE_H
+
+#include <vector>
+#include <algorithm>
+#include "object.h"
+
+using namespace std;
+
+/**
+ * Per-scanline list of horizontal pixel spans [x0, x1) covering a window of
+ * rows [row0, row0 + rows) of a width-wide image.
+ *
+ * Thick lines are added as the quad swept by the line and round joins as a
+ * disc at each vertex. Each primitive only costs one span per row it covers,
+ * however wide it is, and overlapping spans (at joins, or where lines cross)
+ * are merged before filling so every pixel is written once.
+ */
+class SpanBuffer {
+    public:
+        int width;
+        int row0, rows;
+        /* spans[y - row0] holds the unmerged spans of row y */
+        vector<vector<pair<int, int>>> spans;
+
+        /**
+         * Clears the buffer and sets the window of rows it records.
+         * Keeps previously allocated span storage for reuse.
+         */
+        void reset(int width, int row0, int rows);
+
+        /**
+         * Adds the rectangle of the given half width centered on the line
+         * from a to b, without end caps. Pixel (y, x) is covered if its
+         * center (x, y) lies inside the rectangle.
+         */
+        void addSegment(grid_vertex_t a, grid_vertex_t b, double half_width);
+
+        /**
+         * Adds the disc of the given radius centered on c, used as a round
+         * join or cap where lines meet.
+         */
+        void addDisc(grid_vertex_t c, double radius);
+
+        /**
+         * Merges the spans of every row and calls fill(y, x0, x1) once for
+         * each disjoint run of covered pixels [x0, x1), clipped to the image.
+         */
+        template <typename FillFn>
+        void resolve(FillFn fill) {
+            for (int r = 0; r < rows; r++) {
+                vector<pair<int, int>> &row = spans[r];
+                if (row.empty()) {
+                    continue;
+                }
+                sort(row.begin(), row.end());
+
+                int x0 = row[0].first, x1 = row[0].second;
+                for (size_t i = 1; i <= row.size(); i++) {
+                    if (i < row.size() && row[i].first <= x1) {
+                        x1 = max(x1, row[i].second);
+                        continue;
+                    }
+                    int lo = max(x0, 0), hi = min(x1, width);
+                    if (lo < hi) {
+                        fill(row0 + r, lo, hi);
+                    }
+                    if (i < row.size()) {
+                        x0 = row[i].first;
+                        x1 = row[i].second;
+                    }
+                }
+            }
+        }
+
+    private:
+        void addSpan(int y, double x_lo, double x_hi);
+};
+
+#endif
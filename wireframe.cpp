@@ -1,32 +1,124 @@
+#include <cassert>
 #include <cstdlib>
 #include <cstddef>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <cstring>
+#include <unordered_set>
+#include <climits>
+#include <cmath>
+#include <functional>
+#include <numeric>
+#include <string_view>
 
 #include "utils.h"
 #include "transformation.h"
 #include "color.h"
 #include "wireframe.h"
+#include "raster.h"
+#include "ppm.h"
+#include "pipeline.h"
+#include "simplify.h"
 
 using Eigen::Vector4d;
+using Eigen::Vector3d;
+using Eigen::Matrix3d;
 
+/* Rows per task when plotting in parallel, a multiple of FB_TILE 
+   so no tile is written by two tasks */
+static const int PARALLEL_BAND_ROWS = 64;
 
-/* Helper method for Wireframe::processFormatFile */
-void saveTransformedCopy(map<string, Object> &objects,
-                         map<string, Object> &copies,
-                         string objectName, 
-                         Matrix4d transformation) {
-    Object objCopy = objects[objectName].copy();
+/* Hidden-line removal: how far faces are pushed back in depth per unit of 
+   their depth change per pixel, and how much nearer than a face a line 
+   must be to be hidden by it, in NDC depth */
+static const float HIDDEN_SLOPE_OFFSET = 1.0;
+static const float HIDDEN_DEPTH_BIAS = 1e-5;
 
-    /* Generates a unique name for the copy */
-    int copyNumber = 1;
-    string nameAttempt = objectName + "_copy" + to_string(copyNumber);
-    while (copies.find(nameAttempt) != copies.end()) {
+
+/* Repeat line of a copy block: count copies of the block so far, the k-th
+   moved k times by step. before is the transform of the lines since the
+   previous repeat line, or since the block began */
+typedef struct repeat_line {
+    Matrix4d before;
+    int count;
+    Matrix4d step;
+} repeat_line_t;
+
+
+/* Helper method for Wireframe::processFormat: reads the t, r or s 
+   transform starting at line[first] */
+static Matrix4d parseTransform(const vector<string> &line, size_t first) {
+    const string &kind = line.at(first);
+    if (kind[0] == 't') {
+        return translation(stod(line.at(first + 1)), stod(line.at(first + 2)), 
+                           stod(line.at(first + 3)));
+    } else if (kind[0] == 'r') {
+        return rotation(stod(line.at(first + 1)), stod(line.at(first + 2)), 
+                        stod(line.at(first + 3)), stod(line.at(first + 4)));
+    }
+    return scaling(stod(line.at(first + 1)), stod(line.at(first + 2)), stod(line.at(first + 3)));
+}
+
+
+/* Helper method for Wireframe::processFormat: adds an instance of
+   objectName under a unique name, returning its index. 
+   counts holds the copies made so far of each object, so the next name
+   is found without trying the ones before it */
+uint32_t addCopy(vector<instance_t> &instances, unordered_map<string, uint32_t> &names,
+                 unordered_map<string, int> &counts, const string &objectName) {
+    int &copyNumber = counts[objectName];
+    string nameAttempt;
+    do {
         copyNumber++;
         nameAttempt = objectName + "_copy" + to_string(copyNumber);
+    } while (!names.emplace(nameAttempt, instances.size()).second);
+    instances.emplace_back();
+    instances.back().name = move(nameAttempt);
+    instances.back().object_length = objectName.size();
+    instances.back().number = copyNumber;
+    return instances.size() - 1;
+}
+
+
+/* Helper methods for instance transforms, kept as the top three rows of
+   their matrices */
+static scene_matrix_t packMatrix(const Matrix4d &transform) {
+    scene_matrix_t matrix;
+    for (int row = 0; row < 3; row++) {
+        for (int col = 0; col < 4; col++) {
+            matrix.rows[row * 4 + col] = transform(row, col);
+        }
     }
-    objCopy.name = nameAttempt;
+    return matrix;
+}
+
+static Matrix4d unpackMatrix(const scene_matrix_t &matrix) {
+    const double *rows = matrix.rows;
+    Matrix4d transform;
+    transform << rows[0], rows[1], rows[2], rows[3],
+                 rows[4], rows[5], rows[6], rows[7],
+                 rows[8], rows[9], rows[10], rows[11],
+                 0, 0, 0, 1;
+    return transform;
+}
+
+
+/* Helper method for the bounds of copies: moves the sphere at center of
+   the given radius by transform, growing radius by its largest scaling */
+static void moveSphere(const Matrix4d &transform, vertex_t &center, double &radius) {
+    Vector4d moved = transform * Vector4d(center.x, center.y, center.z, 1);
+    center = initVertex(moved[0] / moved[3], moved[1] / moved[3], moved[2] / moved[3]);
+    radius *= transform.topLeftCorner<3, 3>().colwise().norm().maxCoeff();
+}
+
+
+/* Helper method for Wireframe::buildCopy: fills in copy with mesh 
+   transformed by transformation. A null mesh, one never read in, gives
+   an empty copy */
+void saveTransformedCopy(const Object *mesh, Object &copy, const Matrix4d &transformation) {
+    Object objCopy = (mesh == nullptr) ? Object() : mesh->copy();
+    objCopy.mirrored = transformation.topLeftCorner<3, 3>().determinant() < 0;
 
     /* Transforms points of copy via the instructions of the format file */
     for (size_t i = 1; i < objCopy.vertexes.size(); i++) {
@@ -37,13 +129,65 @@ void saveTransformedCopy(map<string, Object> &objects,
         objCopy.vertexes[i].z = result[2] / result[3];
     }
 
-    copies.insert({objCopy.name, objCopy});
+    /* Normals go through the inverse transpose, which keeps them 
+       perpendicular to their faces under scaling */
+    Matrix3d normal_transform = transformation.topLeftCorner<3, 3>().inverse().transpose();
+    for (size_t i = 0; i < objCopy.normals.size(); i++) {
+        Vector3d normal = normal_transform * 
+            Vector3d(objCopy.normals[i].x, objCopy.normals[i].y, objCopy.normals[i].z);
+        if (normal.norm() > 0) {
+            normal.normalize();
+        }
+        objCopy.normals[i] = initVertex(normal[0], normal[1], normal[2]);
+    }
+
+    moveSphere(transformation, objCopy.bound_center, objCopy.bound_radius);
+
+    copy = move(objCopy);
+}
+
+
+/* Helper method for the one pixel wide rasterizers: true if e was 
+   collapsed to a single point by collapseEdges */
+static inline bool isPoint(const grid_edge_t &e) {
+    return e.a.x == e.b.x && e.a.y == e.b.y;
+}
+
+
+/* Helper method for Wireframe::renderBanded and Wireframe::plotBands:
+   bins the index of every line and join by the bands of band_rows rows 
+   it reaches, reach rows beyond its vertexes */
+void binByBand(const vector<grid_edge_t> &edges, const vector<grid_vertex_t> &joins,
+               int band_rows, int reach, long long num_bands,
+               vector<vector<uint32_t>> &edge_bins, vector<vector<uint32_t>> &join_bins) {
+    edge_bins.assign(num_bands, vector<uint32_t>());
+    join_bins.assign(num_bands, vector<uint32_t>());
+    auto bin = [&](vector<vector<uint32_t>> &bins, uint32_t idx, int y_min, int y_max) {
+        long long first = max(0LL, ((long long) y_min - reach) / band_rows);
+        long long last = min(num_bands - 1, ((long long) y_max + reach) / band_rows);
+        for (long long b = first; b <= last; b++) {
+            bins[b].push_back(idx);
+        }
+    };
+    for (size_t i = 0; i < edges.size(); i++) {
+        bin(edge_bins, i, min(edges[i].a.y, edges[i].b.y), max(edges[i].a.y, edges[i].b.y));
+    }
+    for (size_t i = 0; i < joins.size(); i++) {
+        bin(join_bins, i, joins[i].y, joins[i].y);
+    }
 }
 
 
 void Wireframe::processFormatFile(string filename) {
-    if (filename.find(".txt") == -1) {
-        throw invalid_argument("File " + filename + " needs to be a .txt file.");
+    bool binary = filename.size() > 4 && filename.compare(filename.size() - 4, 4, ".wfs") == 0;
+    if (!binary && filename.find(".txt") == -1) {
+        throw invalid_argument("File " + filename + " needs to be a .txt or .wfs file.");
+    }
+    if (binary) {
+        processSceneFile(filename);
+        filename.erase(filename.find('.'));
+        file_name = filename;
+        return;
     }
 
     string buffer;
@@ -57,36 +201,49 @@ void Wireframe::processFormatFile(string filename) {
     filename.erase(filename.find('.'));
     file_name = filename;
 
+    processFormat(file);
+    file.close();
+}
+
+
+void Wireframe::processFormat(istream &file) {
+    Stopwatch watch;
+    string buffer;
     vector<string> line;
 
     /* Reads in camera and perspective parameters */
     while (getline(file, buffer)) {
         line.clear();
         splitBySpace(buffer, line);
+        if (line.size() == 0) {
+            continue;
+        }
 
         if (line[0] == "objects:") {
             break;
         } else if (line[0] == "position") {
-            cam_pos = initVertex(stod(line[1]), stod(line[2]), stod(line[3]));
+            cam_pos = initVertex(stod(line.at(1)), stod(line.at(2)), stod(line.at(3)));
         } else if (line[0] == "orientation") {
-            cam_orien = initVertex(stod(line[1]), stod(line[2]), stod(line[3]));
-            cam_angle = stod(line[4]);
+            cam_orien = initVertex(stod(line.at(1)), stod(line.at(2)), stod(line.at(3)));
+            cam_angle = stod(line.at(4));
         } else if (line[0] == "near") {
-            perspec.near = stod(line[1]);
+            perspec.near = stod(line.at(1));
         } else if (line[0] == "far") {
-            perspec.far = stod(line[1]);
+            perspec.far = stod(line.at(1));
         } else if (line[0] == "left") {
-            perspec.left = stod(line[1]);
+            perspec.left = stod(line.at(1));
         } else if (line[0] == "right") {
-            perspec.right = stod(line[1]);
+            perspec.right = stod(line.at(1));
         } else if (line[0] == "top") {
-            perspec.top = stod(line[1]);
+            perspec.top = stod(line.at(1));
         } else if (line[0] == "bottom") {
-            perspec.bottom = stod(line[1]);
+            perspec.bottom = stod(line.at(1));
         }
     }
 
-    /* Reads in all objects storing them in object maps */
+    /* Reads in all objects, loading them in parallel and storing 
+       them in object maps in file order */
+    vector<pair<string, string>> meshes;
     while (getline(file, buffer)) {
         line.clear();
         splitBySpace(buffer, line);
@@ -94,13 +251,55 @@ void Wireframe::processFormatFile(string filename) {
         if (line.size() == 0) {
             break;
         }
-
-        Object obj = Object("data/" + line[1]);
-        obj.name = line[0];
-        objects.insert({obj.name, obj});
+        meshes.push_back({line[0], line.at(1)});
     }
+    loadMeshes(meshes);
+
+    /* Reads in all tranformations, naming a copy of an object for each
+       and packing its transform into parsed; a copy's vertexes are only
+       made once it's found in view */
+    size_t first_new = instances.size();
+    shared_ptr<vector<scene_matrix_t>> parsed = make_shared<vector<scene_matrix_t>>();
+    /* A block's repeat lines multiply its copies, each copy's transform
+       being built up from the ones before it as the counts are walked
+       like nested loops, the first repeat line outermost */
+    vector<repeat_line_t> repeats;
+    auto add_block = [&](const string &objectName, const Matrix4d &transformation) {
+        long long total = 1;
+        for (const repeat_line_t &repeat : repeats) {
+            total *= repeat.count;
+            if (total > (long long) (UINT32_MAX - instances.size())) {
+                throw invalid_argument("Scene repeats " + objectName + " too many times.");
+            }
+        }
+        if (total > 1) {
+            instances.reserve(instances.size() + total);
+            instance_names.reserve(instances.size() + total);
+            parsed->reserve(parsed->size() + total);
+        }
+
+        function<void(size_t, const Matrix4d &)> expand = [&](size_t depth, const Matrix4d &prefix) {
+            if (depth == repeats.size()) {
+                addInstance(objectName, nullptr);
+                parsed->push_back(packMatrix(transformation * prefix));
+                return;
+            }
+            Matrix4d moved = repeats[depth].before * prefix;
+            for (int k = 0; k < repeats[depth].count; k++) {
+                expand(depth + 1, moved);
+                moved = repeats[depth].step * moved;
+            }
+        };
+        expand(0, Matrix4d::Identity());
+        repeats.clear();
+    };
+    auto add_repeat = [&](int count, const Matrix4d &before, const Matrix4d &step) {
+        if (count < 1) {
+            throw invalid_argument("Scene repeat counts must be positive.");
+        }
+        repeats.push_back({before, count, step});
+    };
 
-    /* Reads in all tranformations, making copies of objects + applying tranformations */
     string objectName = "";
     Matrix4d transformation;
     bool first_run = true;
@@ -109,28 +308,38 @@ void Wireframe::processFormatFile(string filename) {
         splitBySpace(buffer, line);
 
         if (objectName.empty()) {
-            objectName = line[0];
+            objectName = line.at(0);
             continue;
         }
 
         if (line.size() == 0) {
-            saveTransformedCopy(objects, copies, objectName, transformation);
+            add_block(objectName, transformation);
             objectName = "";
             first_run = true;
             continue;
         }
 
-        /* Processes one line of the file as a transformation matrix */
-        Matrix4d curr;
-        if (line[0][0] == 't') {
-            curr = translation(stod(line[1]), stod(line[2]), stod(line[3]));
-        } else if (line[0][0] == 'r') {
-            curr = rotation(stod(line[1]), stod(line[2]), stod(line[3]), 
-                                                        stod(line[4]));;
-        } else {
-            curr = scaling(stod(line[1]), stod(line[2]), stod(line[3]));
+        /* "repeat N t|r|s ..." and "grid NX NY NZ DX DY DZ" close off the
+           lines so far; the ones after apply to every copy */
+        if (line[0] == "repeat" || line[0] == "grid") {
+            Matrix4d before = first_run ? Matrix4d::Identity() : transformation;
+            if (line[0] == "repeat") {
+                add_repeat(stoi(line.at(1)), before, parseTransform(line, 2));
+            } else {
+                add_repeat(stoi(line.at(1)), before, translation(stod(line.at(4)), 0, 0));
+                add_repeat(stoi(line.at(2)), Matrix4d::Identity(), 
+                           translation(0, stod(line.at(5)), 0));
+                add_repeat(stoi(line.at(3)), Matrix4d::Identity(), 
+                           translation(0, 0, stod(line.at(6))));
+            }
+            transformation = Matrix4d::Identity();
+            first_run = false;
+            continue;
         }
 
+        /* Processes one line of the file as a transformation matrix */
+        Matrix4d curr = parseTransform(line, 0);
+
         if (first_run) {
             transformation = curr;
             first_run = false;
@@ -139,8 +348,238 @@ void Wireframe::processFormatFile(string filename) {
 
         transformation = curr * transformation;
     }
-    saveTransformedCopy(objects, copies, objectName, transformation);
-    file.close();
+    add_block(objectName, transformation);
+
+    /* parsed has stopped growing, so the new copies can point into it */
+    for (size_t i = 0; i < parsed->size(); i++) {
+        instances[first_new + i].matrix = &(*parsed)[i];
+    }
+    matrix_arrays.push_back(parsed);
+    sortInstances();
+    stats.addTime("parse scene", watch.elapsedMs());
+}
+
+
+void Wireframe::processSceneFile(const string &filename) {
+    Stopwatch watch;
+    shared_ptr<const SceneFile> mapped = make_shared<SceneFile>(filename);
+    const SceneFile &scene = *mapped;
+    const scene_header_t &header = scene.header();
+    cam_pos = initVertex(header.position[0], header.position[1], header.position[2]);
+    cam_orien = initVertex(header.orientation[0], header.orientation[1], header.orientation[2]);
+    cam_angle = header.orientation[3];
+    perspec.near = header.perspective[0];
+    perspec.far = header.perspective[1];
+    perspec.left = header.perspective[2];
+    perspec.right = header.perspective[3];
+    perspec.top = header.perspective[4];
+    perspec.bottom = header.perspective[5];
+
+    /* Names and files fill their fields up to a NUL, if there is one */
+    vector<string> names(header.mesh_count);
+    vector<pair<string, string>> meshes;
+    for (uint32_t i = 0; i < header.mesh_count; i++) {
+        const scene_mesh_t &mesh = scene.meshes()[i];
+        names[i] = string(mesh.name, strnlen(mesh.name, SCENE_NAME_SIZE));
+        string file(mesh.file, strnlen(mesh.file, SCENE_FILE_SIZE));
+        if (!file.empty()) {
+            meshes.push_back({names[i], file});
+        }
+    }
+    loadMeshes(meshes);
+
+    /* Copies read their transforms from the mapping, kept alive for them */
+    size_t first_new = instances.size();
+    if (header.instance_count > UINT32_MAX - instances.size()) {
+        throw invalid_argument("Scene file '" + filename + "' holds too many instances.");
+    }
+    instances.reserve(first_new + header.instance_count);
+    instance_names.reserve(first_new + header.instance_count);
+    const uint32_t *mesh_ids = scene.meshIds();
+    const scene_matrix_t *matrices = scene.matrices();
+    for (uint64_t i = 0; i < header.instance_count; i++) {
+        if (mesh_ids[i] >= header.mesh_count) {
+            throw invalid_argument("Scene file '" + filename + "' has an instance of no mesh.");
+        }
+        addInstance(names[mesh_ids[i]], &matrices[i]);
+    }
+    matrix_arrays.push_back(mapped);
+
+    sortInstances();
+    stats.addTime("parse scene", watch.elapsedMs());
+}
+
+
+void Wireframe::saveSceneFile(const string &filename) const {
+    scene_header_t header = {};
+    header.position[0] = cam_pos.x;
+    header.position[1] = cam_pos.y;
+    header.position[2] = cam_pos.z;
+    header.orientation[0] = cam_orien.x;
+    header.orientation[1] = cam_orien.y;
+    header.orientation[2] = cam_orien.z;
+    header.orientation[3] = cam_angle;
+    double perspective[6] = {perspec.near, perspec.far, perspec.left, 
+                             perspec.right, perspec.top, perspec.bottom};
+    copy(perspective, perspective + 6, header.perspective);
+
+    /* Groups the copies by object, objects in order of name and each
+       one's copies in the order they were numbered, so reading the file 
+       back gives them the same names */
+    auto object = [&](uint32_t i) {
+        return string_view(instances[i].name).substr(0, instances[i].object_length);
+    };
+    vector<uint32_t> order(instances.size());
+    iota(order.begin(), order.end(), 0);
+    sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        int by_object = object(a).compare(object(b));
+        return by_object < 0 || (by_object == 0 && instances[a].number < instances[b].number);
+    });
+
+    vector<scene_mesh_t> meshes;
+    vector<uint32_t> mesh_ids(instances.size());
+    vector<scene_matrix_t> matrices(instances.size());
+    for (size_t k = 0; k < order.size(); k++) {
+        const instance_t &inst = instances[order[k]];
+        if (k == 0 || object(order[k]) != object(order[k - 1])) {
+            string name(object(order[k]));
+            map<string, string>::const_iterator file = mesh_files.find(name);
+            string file_name = (file == mesh_files.end()) ? "" : file->second;
+            if (name.size() >= SCENE_NAME_SIZE || file_name.size() >= SCENE_FILE_SIZE) {
+                throw invalid_argument("Object " + name + " has too long a name for a scene file.");
+            }
+            scene_mesh_t mesh;
+            memset(&mesh, 0, sizeof(scene_mesh_t));
+            memcpy(mesh.name, name.data(), name.size());
+            memcpy(mesh.file, file_name.data(), file_name.size());
+            meshes.push_back(mesh);
+        }
+        mesh_ids[k] = meshes.size() - 1;
+        matrices[k] = *inst.matrix;
+    }
+    SceneFile::write(filename, header, meshes, mesh_ids, matrices);
+}
+
+
+void Wireframe::loadMeshes(const vector<pair<string, string>> &meshes) {
+    vector<shared_ptr<const Object>> loaded(meshes.size());
+    vector<exception_ptr> errors(meshes.size());
+    TaskGroup loads(scheduler);
+    for (size_t i = 0; i < meshes.size(); i++) {
+        loads.run([&, i]() {
+            try {
+                if (mesh_cache != nullptr) {
+                    loaded[i] = mesh_cache->acquire(mesh_dir + meshes[i].second, lod_pixels > 0);
+                } else {
+                    shared_ptr<Object> obj = make_shared<Object>(mesh_dir + meshes[i].second);
+                    obj->name = meshes[i].first;
+                    if (lod_pixels > 0) {
+                        buildLods(*obj);
+                    }
+                    loaded[i] = obj;
+                }
+            } catch (...) {
+                errors[i] = current_exception();
+            }
+        });
+    }
+    loads.wait();
+    for (size_t i = 0; i < meshes.size(); i++) {
+        if (errors[i]) {
+            rethrow_exception(errors[i]);
+        }
+        objects.insert({meshes[i].first, loaded[i]});
+        mesh_files.insert({meshes[i].first, meshes[i].second});
+    }
+}
+
+
+uint32_t Wireframe::addInstance(const string &objectName, const scene_matrix_t *matrix) {
+    uint32_t idx = addCopy(instances, instance_names, copy_counts, objectName);
+    map<string, shared_ptr<const Object>>::iterator found = objects.find(objectName);
+    instances[idx].mesh = (found == objects.end()) ? nullptr : found->second;
+    instances[idx].matrix = matrix;
+    return idx;
+}
+
+
+/* Helper method for Wireframe::sortInstances: sorts order[begin, end),
+   indexes of instances whose names share their first depth bytes, by name.
+   Each byte is one bucket pass, so the work grows with the names' length
+   rather than the log of their number; short runs are left to sort */
+static void bucketSortNames(const vector<instance_t> &instances, vector<uint32_t> &order,
+                            vector<uint32_t> &spare, size_t begin, size_t end, size_t depth) {
+    if (end - begin < 32) {
+        sort(order.begin() + begin, order.begin() + end, [&](uint32_t a, uint32_t b) {
+            return instances[a].name.compare(depth, string::npos, instances[b].name, depth, string::npos) < 0;
+        });
+        return;
+    }
+
+    /* Bucket 0 holds the name ending at depth, bucket c + 1 those with byte c there */
+    auto bucket = [&](uint32_t idx) {
+        const string &name = instances[idx].name;
+        return (depth < name.size()) ? (unsigned char) name[depth] + 1 : 0;
+    };
+    size_t starts[258] = {0};
+    for (size_t i = begin; i < end; i++) {
+        starts[bucket(order[i]) + 1]++;
+    }
+    for (int b = 0; b < 257; b++) {
+        starts[b + 1] += starts[b];
+    }
+    size_t next[257];
+    memcpy(next, starts, sizeof(next));
+    for (size_t i = begin; i < end; i++) {
+        spare[begin + next[bucket(order[i])]++] = order[i];
+    }
+    copy(spare.begin() + begin, spare.begin() + end, order.begin() + begin);
+
+    /* Names are unique, so only bucket 0 is sure to be done */
+    for (int b = 1; b < 257; b++) {
+        if (starts[b + 1] - starts[b] > 1) {
+            bucketSortNames(instances, order, spare, begin + starts[b], begin + starts[b + 1], depth + 1);
+        }
+    }
+}
+
+
+void Wireframe::sortInstances() {
+    /* Keeps the instances in order of name, the order lines are drawn in */
+    vector<uint32_t> order(instances.size()), spare(instances.size());
+    iota(order.begin(), order.end(), 0);
+    bucketSortNames(instances, order, spare, 0, order.size(), 0);
+    vector<instance_t> sorted;
+    sorted.reserve(instances.size());
+    for (uint32_t idx : order) {
+        sorted.push_back(move(instances[idx]));
+    }
+    instances = move(sorted);
+    for (size_t i = 0; i < instances.size(); i++) {
+        instance_names[instances[i].name] = i;
+    }
+    bvh_built = false;
+    moved_copies.clear();
+    visible_copies.clear();
+}
+
+
+int Wireframe::findInstance(const string &name) const {
+    unordered_map<string, uint32_t>::const_iterator found = instance_names.find(name);
+    return (found == instance_names.end()) ? -1 : (int) found->second;
+}
+
+
+void Wireframe::clearScene() {
+    objects.clear();
+    instances.clear();
+    instance_names.clear();
+    copy_counts.clear();
+    mesh_files.clear();
+    matrix_arrays.clear();
+    bvh_built = false;
+    moved_copies.clear();
+    visible_copies.clear();
 }
 
 
@@ -163,32 +602,213 @@ void Wireframe::computeTransforms() {
 
 
 void Wireframe::applyTransforms() {
+    Stopwatch watch;
     Matrix4d homogenousNDC_transform = perspec_proj_transform * cam_space_transform;
-    for (map<string, Object>::iterator iter = copies.begin(); 
-                                    iter != copies.end(); iter++) {
-        Object& copy = copies[iter->first];
 
-        for (size_t i = 1; i < copy.vertexes.size(); i++) {
-            Vector4d point(copy.vertexes[i].x, copy.vertexes[i].y, copy.vertexes[i].z, 1);
-            Vector4d result = homogenousNDC_transform * point;
-            
-            copy.vertexes[i].x = result[0] / result[3];
-            copy.vertexes[i].y = result[1] / result[3];
-            copy.vertexes[i].z = result[2] / result[3];
+    /* Copies are independent, so each is made and mapped by its own task;
+       only copies in view are ever made */
+    visible_copies = cullCopies(homogenousNDC_transform);
+    parallelFor(scheduler, 0, visible_copies.size(), 1, [&](size_t lo, size_t hi) {
+        for (size_t k = lo; k < hi; k++) {
+            instance_t &inst = instances[visible_copies[k]];
+            int level = 0;
+            if (lod_pixels > 0) {
+                Matrix4d view = inst.placed ? Matrix4d(cam_space_transform * inst.placement)
+                                            : cam_space_transform;
+                level = selectLod(inst, view);
+            }
+            buildCopy(inst, level);
+            mapToGrid(inst.copy, inst.placed ? Matrix4d(homogenousNDC_transform * inst.placement)
+                                             : homogenousNDC_transform);
+        }
+    });
+    stats.addTime("transform", watch.elapsedMs());
+
+    if (stats.enabled && lod_pixels > 0) {
+        long long simplified = 0, faces = 0;
+        for (uint32_t i : visible_copies) {
+            simplified += instances[i].level > 0;
+            faces += instances[i].copy.faces.size();
+        }
+        stats.addCount("copies simplified", simplified);
+        stats.addCount("faces after lod", faces);
+    }
+}
+
+
+void Wireframe::placeInstance(uint32_t idx, const Matrix4d &placement) {
+    instance_t &inst = instances[idx];
+    inst.placement = placement;
+    inst.placed = true;
+    if (!inst.moved) {
+        inst.moved = true;
+        moved_copies.push_back(idx);
+    }
+}
+
+
+box_t Wireframe::copyBounds(const instance_t &inst) const {
+    /* The full mesh's sphere; collapses stay on mesh edges, so it bounds
+       the levels of detail too */
+    vertex_t center = initVertex(0, 0, 0);
+    double radius = 0;
+    if (inst.mesh != nullptr) {
+        center = inst.mesh->bound_center;
+        radius = inst.mesh->bound_radius;
+    }
+    moveSphere(unpackMatrix(*inst.matrix), center, radius);
+    if (inst.placed) {
+        moveSphere(inst.placement, center, radius);
+    }
+    return sphereBox(center, radius);
+}
+
+
+vector<uint32_t> Wireframe::cullCopies(const Matrix4d &ndc_transform) {
+    /* Works out every copy's box for a new scene; after that only the 
+       moved copies' boxes change, and the tree is refit to just those
+       until refitting has doubled the area of its boxes */
+    bool rebuild = !bvh_built;
+    if (rebuild) {
+        Stopwatch bounds_watch;
+        copy_bounds.resize(instances.size());
+        parallelFor(scheduler, 0, instances.size(), 256, [&](size_t lo, size_t hi) {
+            for (size_t i = lo; i < hi; i++) {
+                copy_bounds[i] = copyBounds(instances[i]);
+            }
+        });
+        stats.addTime("copy bounds", bounds_watch.elapsedMs());
+    } else if (!moved_copies.empty()) {
+        Stopwatch refit_watch;
+        for (uint32_t i : moved_copies) {
+            copy_bounds[i] = copyBounds(instances[i]);
+        }
+        copy_bvh.refit(copy_bounds, moved_copies);
+        rebuild = copy_bvh.area > 2 * copy_bvh.built_area;
+        stats.addTime("bvh refit", refit_watch.elapsedMs());
+    }
+    if (stats.enabled) {
+        stats.addCount("copies moved", moved_copies.size());
+    }
+    for (uint32_t i : moved_copies) {
+        instances[i].moved = false;
+    }
+    moved_copies.clear();
+    if (rebuild) {
+        Stopwatch build_watch;
+        copy_bvh.build(copy_bounds, scheduler);
+        bvh_built = true;
+        stats.addTime("bvh build", build_watch.elapsedMs());
+    }
+
+    /* Planes keeping a point's NDC x and y where mapToGrid maps it onto 
+       the grid, with a pixel to spare; see mapToGrid for the mapping */
+    double width = perspec.right - perspec.left, height = perspec.top - perspec.bottom;
+    double x_margin = 2 * width / xres, y_margin = 2 * height / yres;
+    double x_lo = perspec.left - 0.5 * width - x_margin;
+    double x_hi = perspec.left + 1.5 * width + x_margin;
+    double y_lo = perspec.top - 1.5 * height - y_margin;
+    double y_hi = perspec.top + 0.5 * height + y_margin;
+    Vector4d x_row = ndc_transform.row(0), y_row = ndc_transform.row(1);
+    Vector4d w_row = ndc_transform.row(3);
+    Vector4d sides[4] = {x_row - x_lo * w_row, x_hi * w_row - x_row,
+                         y_row - y_lo * w_row, y_hi * w_row - y_row};
+    frustum_t view;
+    for (int s = 0; s < 4; s++) {
+        for (int k = 0; k < 4; k++) {
+            view.sides[s][k] = sides[s][k];
+        }
+    }
+    for (int k = 0; k < 4; k++) {
+        view.front[k] = w_row[k];
+    }
+
+    Stopwatch query_watch;
+    vector<uint32_t> visible;
+    size_t visited = copy_bvh.query(view, visible);
+    sort(visible.begin(), visible.end());
+    stats.addTime("bvh query", query_watch.elapsedMs());
+    if (stats.enabled) {
+        stats.addCount("bvh nodes", copy_bvh.nodeCount());
+        stats.addCount("bvh nodes visited", visited);
+        stats.addCount("copies culled", instances.size() - visible.size());
+    }
+    return visible;
+}
+
 
-            /* 
-             * Mapping: [x, y] --> 
-             * [(x + left) * xres / (right + left), (top - y) * yres / (top + bottom)]
-            */
-            int grid_x = round(0.5 * xres * ((copy.vertexes[i].x - perspec.left) / 
-                    (perspec.right - perspec.left) + 0.5) );
+int Wireframe::selectLod(const instance_t &inst, const Matrix4d &view) const {
+    int level = 0;
+    if (inst.mesh != nullptr && !inst.mesh->lods.empty()) {
+        /* Nearest the sphere around the copy comes to the camera */
+        Matrix4d transformation = unpackMatrix(*inst.matrix);
+        vertex_t center = inst.mesh->bound_center;
+        double radius = inst.mesh->bound_radius;
+        moveSphere(transformation, center, radius);
+        moveSphere(view, center, radius);
+        double distance = -center.z - radius;
 
-            int grid_y = round(0.5 * yres * ((perspec.top - copy.vertexes[i].y) / 
-                    (perspec.top - perspec.bottom) + 0.5) );
+        if (distance > perspec.near) {
+            /* Output pixels per unit across the line of sight at distance,
+               as mapToGrid maps the near plane onto the grid */
+            double width = perspec.right - perspec.left, height = perspec.top - perspec.bottom;
+            double pixels = perspec.near / distance * 
+                            max(xres / (width * width), yres / (height * height));
+            /* Errors are in the full mesh's units, which the scene
+               transform scales too */
+            pixels *= view.topLeftCorner<3, 3>().colwise().norm().maxCoeff() *
+                      transformation.topLeftCorner<3, 3>().colwise().norm().maxCoeff();
 
-            copy.pixels.push_back(initGridVertex(grid_x, grid_y));
+            const vector<lod_level_t> &lods = inst.mesh->lods;
+            while (level < (int) lods.size() && lods[level].error * pixels <= lod_pixels) {
+                level++;
+            }
+        }
+    }
+
+    return level;
+}
+
+
+void Wireframe::buildCopy(instance_t &inst, int level) {
+    if (level != inst.level) {
+        const Object *mesh = (level == 0) ? inst.mesh.get() : inst.mesh->lods[level - 1].mesh.get();
+        saveTransformedCopy(mesh, inst.copy, unpackMatrix(*inst.matrix));
+        /* Levels are only picked from inst.mesh; a copy never carries its own */
+        assert(inst.copy.lods.empty());
+        inst.level = level;
+    }
+}
+
+
+void Wireframe::mapToGrid(Object &copy, const Matrix4d &copy_transform) {
+    /* Vertexes are mapped to the supersampled grid when SSAA is on */
+    int grid_xres = xres * ssaa;
+    int grid_yres = yres * ssaa;
+
+    /* Overwrites the pixels of any earlier frame, keeping vertexes as is */
+    copy.pixels.resize(copy.vertexes.size());
+    copy.depths.resize((cull_mode == CULL_HIDDEN) ? copy.vertexes.size() : 0);
+    for (size_t i = 1; i < copy.vertexes.size(); i++) {
+        Vector4d point(copy.vertexes[i].x, copy.vertexes[i].y, copy.vertexes[i].z, 1);
+        Vector4d result = copy_transform * point;
+        vertex_t ndc = initVertex(result[0] / result[3], result[1] / result[3], 
+                                  result[2] / result[3]);
+
+        /* 
+         * Mapping: [x, y] --> 
+         * [(x + left) * xres / (right + left), (top - y) * yres / (top + bottom)]
+        */
+        int grid_x = round(0.5 * grid_xres * ((ndc.x - perspec.left) / 
+                (perspec.right - perspec.left) + 0.5) );
+
+        int grid_y = round(0.5 * grid_yres * ((perspec.top - ndc.y) / 
+                (perspec.top - perspec.bottom) + 0.5) );
+
+        copy.pixels[i] = initGridVertex(grid_x, grid_y);
+        if (!copy.depths.empty()) {
+            copy.depths[i] = (result[3] > 0) ? ndc.z : NAN;
         }
-        
     }
 }
 
@@ -203,7 +823,10 @@ bool Wireframe::pointInBound(int y, int x) {
 
 void Wireframe::plotPoint(int y, int x, float shade) {
     if (pointInBound(y, x)) {
-        grid[y][x] = shade;
+        grid.set(y, x, shade);
+        if (l1_model && !l1_model->access(grid.address(y, x))) {
+            l2_model->access(grid.address(y, x));
+        }
     }
 }
 
@@ -223,9 +846,9 @@ void Wireframe::bresenhamRasterize(grid_vertex_t v1, grid_vertex_t v2, bool anti
         upper = v1;
     }
 
-    // Calculates slope, dx, dy
-    int dx = upper.x - lower.x;
-    int dy = upper.y - lower.y;
+    // Calculates slope, dx, dy (64-bit so eps_d << 1 can't overflow)
+    long long dx = (long long) upper.x - lower.x;
+    long long dy = (long long) upper.y - lower.y;
     float slope = dy * 1.0 / dx;
 
     /* 
@@ -248,8 +871,10 @@ void Wireframe::bresenhamRasterize(grid_vertex_t v1, grid_vertex_t v2, bool anti
      Defaults base & increment to iterate over x i.e mild slopes (m: [-1, 1])
      If steep slope (|m| > 1), sets base & increment to iterate over y
     */
-    int base = lower.y, d_base = dy;
-    int incr_low = lower.x, incr_up = upper.x, d_incr = dx;
+    int base = lower.y;
+    long long d_base = dy;
+    int incr_low = lower.x, incr_up = upper.x;
+    long long d_incr = dx;
     bool iterate_over_x = true;
     if (slope < -1 || slope > 1) {
         base = lower.x;
@@ -260,7 +885,7 @@ void Wireframe::bresenhamRasterize(grid_vertex_t v1, grid_vertex_t v2, bool anti
         iterate_over_x = false;
     }
 
-    int eps_d = 0;
+    long long eps_d = 0;
     for (int incr = incr_low; incr <= incr_up; incr++) {
 
         // checks if we're iterating over x or y
@@ -316,107 +941,737 @@ void Wireframe::bresenhamRasterize(grid_vertex_t v1, grid_vertex_t v2, bool anti
 
 
 void Wireframe::plot(bool antialiase) {
-    // Allocates data for and zeroes out Pixel Grid
-    grid = (float **) malloc(yres * sizeof(float *));
-    for (int y = 0; y < yres; y++) {
-        grid[y] = (float *) malloc(xres * sizeof(float));
-        for (int x = 0; x < xres; x++) {
-            grid[y][x] = 0;
+    Stopwatch watch;
+
+    // Allocates data for and zeroes out Pixel Grid, reusing the last one if it fits
+    if (target_pixels != nullptr) {
+        if (fb_layout != FB_ROW_MAJOR) {
+            throw logic_error("Only a row-major Pixel Grid can draw into a target.");
+        }
+        if (!grid_wrapped) {
+            destruct();
         }
+        grid.wrap(target_pixels, xres, yres, target_stride);
+        grid.clear();
+        grid_allocated = true;
+        grid_wrapped = true;
+    } else if (grid.width == xres && grid.height == yres && grid.layout == fb_layout && 
+                                                     grid_allocated && !grid_wrapped) {
+        grid.clear();
+    } else {
+        destruct();
+        grid.allocate(xres, yres, fb_layout);
+        grid_allocated = true;
     }
 
+    if (ssaa > 1) {
+        plotSupersampled();
+    } else if (line_width > 1) {
+        plotThick();
+    } else {
+        plotLines(antialiase);
+    }
+    stats.addTime("plot", watch.elapsedMs());
+    if (stats.enabled) {
+        stats.addCount("framebuffer bytes", grid.bytesAllocated());
+    }
+}
+
+
+void Wireframe::plotLines(bool antialiase) {
     /* Renders all lines that lie on the Pixel Grid by computing Bresenham's 
        Algorithm for the 3 lines of every face of every copied object */
-    for (map<string, Object>::iterator obj_iter = copies.begin(); 
-                                    obj_iter != copies.end(); obj_iter++) {
-        for (size_t face_idx = 0; 
-                face_idx < copies[obj_iter->first].faces.size(); face_idx++) {
-            face_t face = copies[obj_iter->first].faces[face_idx];
-            grid_vertex_t v1 = copies[obj_iter->first].pixels[face.v1];
-            grid_vertex_t v2 = copies[obj_iter->first].pixels[face.v2];
-            grid_vertex_t v3 = copies[obj_iter->first].pixels[face.v3];
-            bresenhamRasterize(v1, v2, antialiase);
-            bresenhamRasterize(v2, v3, antialiase);
-            bresenhamRasterize(v3, v1, antialiase);
+    vector<grid_edge_t> edges;
+    vector<grid_vertex_t> joins;
+    gatherEdges(xres, yres, false, edges, joins);
+
+    Stopwatch sort_watch;
+    sortEdges(edges, xres, yres, edge_order);
+    if (edge_order != EDGE_ORDER_SCENE) {
+        stats.addTime("edge sort", sort_watch.elapsedMs());
+    }
+    collapseSubpixelEdges(edges);
+
+    /* Typical L1d and L2 sizes, fed with every Pixel Grid write */
+    CacheModel l1(32 * 1024, 8), l2(1024 * 1024, 16);
+    if (stats.model_cache) {
+        l1_model = &l1;
+        l2_model = &l2;
+    }
+
+    /* The cache models follow a single stream of writes */
+    if (rasterScheduler() != nullptr && !stats.model_cache) {
+        plotBands(edges, joins, false, antialiase);
+    } else {
+        auto rasterize = [&]() {
+            for (size_t i = 0; i < edges.size(); i++) {
+                if (isPoint(edges[i])) {
+                    plotPoint(edges[i].a.y, edges[i].a.x, 1);
+                } else {
+                    bresenhamRasterize(edges[i].a, edges[i].b, antialiase);
+                }
+            }
+        };
+        /* The counter sees only this thread, so only serial loops are counted */
+        if (stats.enabled) {
+            HardwareCounter counter;
+            counter.start();
+            rasterize();
+            stats.addCount("raster hw misses, calling thread", counter.stop());
+        } else {
+            rasterize();
         }
     }
+
+    if (stats.enabled) {
+        stats.addCount("edges rasterized", edges.size());
+    }
+    if (stats.model_cache) {
+        stats.addCount("raster modeled writes", l1.accesses);
+        stats.addCount("raster modeled L1 misses", l1.misses);
+        stats.addCount("raster modeled L2 misses", l2.misses);
+        l1_model = nullptr;
+        l2_model = nullptr;
+    }
 }
 
 
-void Wireframe::output(bool printToStd) {
-    ofstream ppm;
-    string filename = file_name + ".ppm";
-    ppm.open(filename.c_str(), ios::out);
-    if (!ppm) {
-        string msg = "Could not create '" + filename + "'.";
-        throw runtime_error(msg);
+void Wireframe::collapseSubpixelEdges(vector<grid_edge_t> &edges) {
+    Stopwatch watch;
+    long long collapsed, dropped;
+    collapseEdges(edges, xres, yres, collapsed, dropped);
+    stats.addTime("edge collapse", watch.elapsedMs());
+    if (stats.enabled) {
+        stats.addCount("edges collapsed", collapsed);
+        stats.addCount("repeated points dropped", dropped);
     }
-    
-    ppm << "P3\n" << xres << " " << yres << "\n255\n";
-    if (printToStd) {
-        cout << "P3\n" << xres << " " << yres << "\n255\n";
+}
+
+
+void Wireframe::gatherEdges(int grid_xres, int grid_yres, bool unique,
+                            vector<grid_edge_t> &edges, vector<grid_vertex_t> &joins) {
+    long long culled = 0, outlines = 0;
+    bool hidden = cull_mode == CULL_HIDDEN;
+    bool outline = edge_mode == EDGES_OUTLINE;
+    double crease_cos = cos(crease_angle * M_PI / 180);
+    vector<float> edge_depths, join_depths;
+    for (uint32_t i : visible_copies) {
+        const instance_t &inst = instances[i];
+        const Object &copy = inst.copy;
+        unordered_set<uint64_t> seen;
+        vector<bool> joined(unique ? copy.pixels.size() : 0, false);
+
+        /* Adds the line between vertexes i and j if both lie on the grid */
+        auto add_line = [&](int i, int j, bool shared) {
+            grid_vertex_t a = copy.pixels[i], b = copy.pixels[j];
+            if (a.x < 0 || a.x >= grid_xres || a.y < 0 || a.y >= grid_yres ||
+                b.x < 0 || b.x >= grid_xres || b.y < 0 || b.y >= grid_yres) {
+                return;
+            }
+            if (unique) {
+                uint64_t key = ((uint64_t) min(i, j) << 32) | (uint32_t) max(i, j);
+                if (shared && !seen.insert(key).second) {
+                    return;
+                }
+                for (int k : {i, j}) {
+                    if (!joined[k]) {
+                        joined[k] = true;
+                        joins.push_back(copy.pixels[k]);
+                        if (hidden) {
+                            join_depths.push_back(copy.depths[k]);
+                        }
+                    }
+                }
+            }
+            edges.push_back(initGridEdge(a, b));
+            if (hidden) {
+                edge_depths.push_back(copy.depths[i]);
+                edge_depths.push_back(copy.depths[j]);
+            }
+        };
+
+        if (outline) {
+            /* Which side of each face the camera is on. The animated 
+               transform is affine, so moving the camera back through it
+               gives the same side as moving the copy */
+            Vector4d eye(cam_pos.x, cam_pos.y, cam_pos.z, 1);
+            if (inst.placed) {
+                eye = inst.placement.inverse() * eye;
+                eye /= eye[3];
+            }
+            vector<bool> front(copy.faces.size());
+            for (size_t face_idx = 0; face_idx < copy.faces.size(); face_idx++) {
+                vertex_t n = copy.normals[face_idx];
+                vertex_t v = copy.vertexes[copy.faces[face_idx].v1];
+                front[face_idx] = n.x * (eye[0] - v.x) + n.y * (eye[1] - v.y) + 
+                                  n.z * (eye[2] - v.z) > 0;
+                if (cull_mode == CULL_BACKFACE && !front[face_idx]) {
+                    culled++;
+                }
+            }
+
+            for (const mesh_edge_t &edge : copy.edges) {
+                bool front1 = front[edge.f1];
+                bool front2 = edge.f2 >= 0 && front[edge.f2];
+                if (cull_mode == CULL_BACKFACE && !front1 && !front2) {
+                    continue;
+                }
+                if (edge.f2 >= 0 && front1 == front2) {
+                    vertex_t n1 = copy.normals[edge.f1], n2 = copy.normals[edge.f2];
+                    if (!front1 || n1.x * n2.x + n1.y * n2.y + n1.z * n2.z >= crease_cos) {
+                        continue;
+                    }
+                }
+                size_t before = edges.size();
+                add_line(edge.v1, edge.v2, false);
+                outlines += edges.size() - before;
+            }
+            continue;
+        }
+
+        /* Faces wind counterclockwise seen from the front. The grid's y 
+           axis points down, so front faces wind clockwise on it unless
+           the copy is mirrored by its own or its animated transform */
+        bool mirrored = copy.mirrored;
+        if (inst.placed && inst.placement.topLeftCorner<3, 3>().determinant() < 0) {
+            mirrored = !mirrored;
+        }
+
+        for (size_t face_idx = 0; face_idx < copy.faces.size(); face_idx++) {
+            face_t face = copy.faces[face_idx];
+            int idx[3] = {face.v1, face.v2, face.v3};
+            if (cull_mode == CULL_BACKFACE) {
+                grid_vertex_t p1 = copy.pixels[face.v1], p2 = copy.pixels[face.v2],
+                              p3 = copy.pixels[face.v3];
+                /* Twice the signed area; edge-on faces (0) are kept */
+                long long area = (long long) (p2.x - p1.x) * (p3.y - p1.y) -
+                                 (long long) (p3.x - p1.x) * (p2.y - p1.y);
+                if (mirrored ? area < 0 : area > 0) {
+                    culled++;
+                    continue;
+                }
+            }
+            for (int e = 0; e < 3; e++) {
+                add_line(idx[e], idx[(e + 1) % 3], true);
+            }
+        }
+    }
+    if (stats.enabled && cull_mode == CULL_BACKFACE) {
+        stats.addCount("faces culled", culled);
+    }
+    if (stats.enabled && outline) {
+        stats.addCount("outline lines", outlines);
+    }
+    if (hidden) {
+        removeHiddenLines(grid_xres, grid_yres, edges, edge_depths, joins, join_depths);
+    }
+}
+
+
+void Wireframe::removeHiddenLines(int grid_xres, int grid_yres,
+                                  vector<grid_edge_t> &edges, const vector<float> &edge_depths,
+                                  vector<grid_vertex_t> &joins, const vector<float> &join_depths) {
+    Stopwatch watch;
+    /* Bins every face between the near and far planes by the bands it 
+       covers; faces reaching off the grid still hide what's behind them */
+    const int MAX_COORD = 1 << 24;
+    long long num_bands = ((long long) grid_yres + PARALLEL_BAND_ROWS - 1) / PARALLEL_BAND_ROWS;
+    vector<vector<pair<const Object *, uint32_t>>> face_bins(num_bands);
+    for (uint32_t i : visible_copies) {
+        const Object &copy = instances[i].copy;
+        for (size_t face_idx = 0; face_idx < copy.faces.size(); face_idx++) {
+            face_t face = copy.faces[face_idx];
+            int y_min = INT_MAX, y_max = INT_MIN;
+            bool usable = true;
+            for (int k : {face.v1, face.v2, face.v3}) {
+                grid_vertex_t p = copy.pixels[k];
+                usable = usable && copy.depths[k] >= -1 && copy.depths[k] <= 1 &&
+                         abs(p.x) < MAX_COORD && abs(p.y) < MAX_COORD;
+                y_min = min(y_min, p.y);
+                y_max = max(y_max, p.y);
+            }
+            if (!usable || y_max < 0 || y_min >= grid_yres) {
+                continue;
+            }
+            for (long long b = max(0, y_min) / PARALLEL_BAND_ROWS; 
+                    b <= min(grid_yres - 1, y_max) / PARALLEL_BAND_ROWS; b++) {
+                face_bins[b].push_back({&copy, face_idx});
+            }
+        }
+    }
+
+    depth.resize(grid_xres, grid_yres);
+    parallelFor(scheduler, 0, num_bands, 1, [&](size_t lo, size_t hi) {
+        for (size_t b = lo; b < hi; b++) {
+            int row0 = b * PARALLEL_BAND_ROWS;
+            int row_end = min(row0 + PARALLEL_BAND_ROWS, grid_yres);
+            depth.clearRows(row0, row_end);
+            for (size_t i = 0; i < face_bins[b].size(); i++) {
+                const Object &copy = *face_bins[b][i].first;
+                face_t face = copy.faces[face_bins[b][i].second];
+                depth.addTriangle(copy.pixels[face.v1], copy.depths[face.v1],
+                                  copy.pixels[face.v2], copy.depths[face.v2],
+                                  copy.pixels[face.v3], copy.depths[face.v3],
+                                  row0, row_end, HIDDEN_SLOPE_OFFSET);
+            }
+            depth.updateTiles(row0, row_end);
+        }
+    });
+    stats.addTime("depth buffer", watch.elapsedMs());
+
+    /* Clips the edges a chunk per task, then joins the chunks in order */
+    Stopwatch clip_watch;
+    const size_t CHUNK_EDGES = 1024;
+    size_t num_chunks = (edges.size() + CHUNK_EDGES - 1) / CHUNK_EDGES;
+    vector<vector<grid_edge_t>> chunks(num_chunks);
+    vector<long long> tests(3 * num_chunks, 0);
+    parallelFor(scheduler, 0, num_chunks, 1, [&](size_t lo, size_t hi) {
+        for (size_t c = lo; c < hi; c++) {
+            for (size_t i = c * CHUNK_EDGES; i < min(edges.size(), (c + 1) * CHUNK_EDGES); i++) {
+                line_test_t test = depth.clipLine(edges[i].a, edge_depths[2 * i], 
+                                                  edges[i].b, edge_depths[2 * i + 1], 
+                                                  HIDDEN_DEPTH_BIAS, chunks[c]);
+                tests[3 * c + test]++;
+            }
+        }
+    });
+    long long line_tests[3] = {0, 0, 0};
+    size_t total_lines = edges.size();
+    edges.clear();
+    for (size_t c = 0; c < num_chunks; c++) {
+        edges.insert(edges.end(), chunks[c].begin(), chunks[c].end());
+        for (int t = 0; t < 3; t++) {
+            line_tests[t] += tests[3 * c + t];
+        }
+    }
+
+    size_t kept = 0;
+    for (size_t i = 0; i < joins.size(); i++) {
+        if (join_depths[i] <= depth.at(joins[i].y, joins[i].x) + HIDDEN_DEPTH_BIAS) {
+            joins[kept++] = joins[i];
+        }
     }
+    joins.resize(kept);
+    stats.addTime("hidden line clip", clip_watch.elapsedMs());
 
-    color_rgb_t color = initColor(255, 255, 255);
-    string unfilledStr = "0 0 0";
+    if (stats.enabled) {
+        stats.addCount("hidden test lines", total_lines);
+        stats.addCount("lines accepted by tile", line_tests[LINE_ACCEPTED]);
+        stats.addCount("lines rejected by tile", line_tests[LINE_REJECTED]);
+        stats.addCount("lines tested per pixel", line_tests[LINE_WALKED]);
+        stats.addCount("visible line runs", edges.size());
+        stats.addCount("depth buffer bytes", depth.bytesAllocated());
+    }
+}
+
+
+void Wireframe::plotThick() {
+    vector<grid_edge_t> edges;
+    vector<grid_vertex_t> joins;
+    gatherEdges(xres, yres, true, edges, joins);
+
+    if (rasterScheduler() != nullptr) {
+        plotBands(edges, joins, true, false);
+        return;
+    }
 
-    for (int y = 0; y < yres; y++) {
-        for (int x = 0; x < xres; x++) {
-            float fill = grid[y][x];
-            if (fill == 0) {
-                ppm << unfilledStr << endl;
-                if (printToStd) {
-                    cout << unfilledStr << endl;
+    double half_width = line_width / 2;
+    SpanBuffer spans;
+    spans.reset(xres, 0, yres);
+    for (size_t i = 0; i < edges.size(); i++) {
+        spans.addSegment(edges[i].a, edges[i].b, half_width);
+    }
+    for (size_t i = 0; i < joins.size(); i++) {
+        spans.addDisc(joins[i], half_width);
+    }
+
+    spans.resolve([&](int y, int x0, int x1) {
+        for (int x = x0; x < x1; x++) {
+            grid.set(y, x, 1);
+        }
+    });
+}
+
+
+void Wireframe::plotBands(const vector<grid_edge_t> &edges, 
+                          const vector<grid_vertex_t> &joins, bool thick, bool antialiase) {
+    double half_width = line_width / 2;
+    int reach = thick ? (int) ceil(half_width) : (antialiase ? 1 : 0);
+    long long num_bands = ((long long) yres + PARALLEL_BAND_ROWS - 1) / PARALLEL_BAND_ROWS;
+    vector<vector<uint32_t>> edge_bins, join_bins;
+    binByBand(edges, joins, PARALLEL_BAND_ROWS, reach, num_bands, edge_bins, join_bins);
+
+    /* Each band only writes its own rows, drawing its lines in the
+       same order as the serial loop, so the image is the same */
+    parallelFor(scheduler, 0, num_bands, 1, [&](size_t lo, size_t hi) {
+        SpanBuffer spans;
+        for (size_t b = lo; b < hi; b++) {
+            long long row0 = b * PARALLEL_BAND_ROWS;
+            long long row_end = min(row0 + PARALLEL_BAND_ROWS, (long long) yres);
+            if (thick) {
+                spans.reset(xres, row0, row_end - row0);
+                for (size_t i = 0; i < edge_bins[b].size(); i++) {
+                    const grid_edge_t &e = edges[edge_bins[b][i]];
+                    spans.addSegment(e.a, e.b, half_width);
                 }
-            } else {
-                string magnitudeStr = toString(scaleColor(color, fill));
-                ppm << magnitudeStr << endl;
-                if (printToStd) {
-                    cout << magnitudeStr << endl;
+                for (size_t i = 0; i < join_bins[b].size(); i++) {
+                    spans.addDisc(joins[join_bins[b][i]], half_width);
+                }
+                spans.resolve([&](int y, int x0, int x1) {
+                    for (int x = x0; x < x1; x++) {
+                        grid.set(y, x, 1);
+                    }
+                });
+                continue;
+            }
+
+            auto plot_band = [&](long long y, long long x, float shade) {
+                if (y >= row0 && y < row_end && x >= 0 && x < xres) {
+                    grid.set(y, x, shade);
+                }
+            };
+            for (size_t i = 0; i < edge_bins[b].size(); i++) {
+                const grid_edge_t &e = edges[edge_bins[b][i]];
+                if (isPoint(e)) {
+                    plot_band(e.a.y, e.a.x, 1);
+                } else {
+                    walkLineRows(e.a, e.b, row0 - reach, row_end + reach, antialiase, plot_band);
                 }
             }
         }
+    });
+}
+
+
+Scheduler *Wireframe::rasterScheduler() {
+    /* Sparse tiles are allocated on first write, which isn't thread safe */
+    return (grid.layout == FB_SPARSE) ? nullptr : scheduler;
+}
+
+
+void Wireframe::plotSupersampled() {
+    /* Output rows filtered per strip; bounds the coverage buffer's size */
+    const int STRIP_ROWS = 16;
+
+    DownsampleFilter filter(ssaa, ssaa_filter);
+    int ss_xres = xres * ssaa;
+    int ss_yres = yres * ssaa;
+    int num_strips = (yres + STRIP_ROWS - 1) / STRIP_ROWS;
+    bool thick = line_width > 1;
+    double half_width = line_width * ssaa / 2;
+    int reach = thick ? (int) ceil(half_width) : 0;
+
+    vector<grid_edge_t> edges;
+    vector<grid_vertex_t> joins;
+    gatherEdges(ss_xres, ss_yres, thick, edges, joins);
+    sortEdges(edges, ss_xres, ss_yres, edge_order);
+
+    /* Bins every line (and join) into each strip whose output rows 
+       it can reach through its width and the filter's footprint */
+    auto strip_range = [&](int y_min, int y_max, int &first, int &last) {
+        int first_y = max(0, (y_min - reach - filter.hi) / ssaa);
+        int last_y = min(yres - 1, (y_max + reach - filter.lo) / ssaa);
+        first = first_y / STRIP_ROWS;
+        last = last_y / STRIP_ROWS;
+    };
+    vector<vector<grid_edge_t>> edge_bins(num_strips);
+    vector<vector<grid_vertex_t>> join_bins(num_strips);
+    for (size_t i = 0; i < edges.size(); i++) {
+        int first, last;
+        strip_range(min(edges[i].a.y, edges[i].b.y), max(edges[i].a.y, edges[i].b.y),
+                    first, last);
+        for (int s = first; s <= last; s++) {
+            edge_bins[s].push_back(edges[i]);
+        }
+    }
+    for (size_t i = 0; i < joins.size(); i++) {
+        int first, last;
+        strip_range(joins[i].y, joins[i].y, first, last);
+        for (int s = first; s <= last; s++) {
+            join_bins[s].push_back(joins[i]);
+        }
     }
 
+    /* Strips write disjoint output rows, so each can be its own task */
+    parallelFor(rasterScheduler(), 0, num_strips, 1, [&](size_t lo, size_t hi) {
+        CoverageStrip strip;
+        SpanBuffer spans;
+        for (size_t s = lo; s < hi; s++) {
+            int y0 = s * STRIP_ROWS;
+            int rows = min(STRIP_ROWS, yres - y0);
+            int row0 = max(0, y0 * ssaa + filter.lo);
+            int row_end = min(ss_yres, (y0 + rows - 1) * ssaa + filter.hi + 1);
+
+            strip.reset(ss_xres, row0, row_end - row0);
+            if (thick) {
+                spans.reset(ss_xres, row0, row_end - row0);
+                for (size_t i = 0; i < edge_bins[s].size(); i++) {
+                    spans.addSegment(edge_bins[s][i].a, edge_bins[s][i].b, half_width);
+                }
+                for (size_t i = 0; i < join_bins[s].size(); i++) {
+                    spans.addDisc(join_bins[s][i], half_width);
+                }
+                spans.resolve([&](int y, int x0, int x1) {
+                    memset(&strip.cells[(size_t) (y - row0) * strip.stride + x0], 1, 
+                           x1 - x0);
+                });
+            } else {
+                for (size_t i = 0; i < edge_bins[s].size(); i++) {
+                    strip.coverLine(edge_bins[s][i].a, edge_bins[s][i].b);
+                }
+            }
+            downsampleStrip(strip, filter, y0, rows, grid);
+        }
+    });
+}
+
+
+void Wireframe::output(bool printToStd) {
+    Stopwatch watch;
+    PpmWriter ppm(file_name + output_suffix + ".ppm", xres, yres, printToStd);
+    ppm.scheduler = scheduler;
+    ppm.writeRows(grid, 0, yres);
     ppm.close();
+    stats.addTime("output", watch.elapsedMs());
 }
 
 
-void Wireframe::destruct() {
-    for (int y = 0; y < yres; y++) {
-        free(grid[y]);
+void Wireframe::encode(ostream &out) {
+    Stopwatch watch;
+    PpmWriter ppm(out, xres, yres);
+    ppm.scheduler = scheduler;
+    ppm.writeRows(grid, 0, yres);
+    stats.addTime("output", watch.elapsedMs());
+}
+
+
+frame_view_t Wireframe::view() {
+    if (!grid_allocated) {
+        throw logic_error("There is no image to view before plot runs.");
+    }
+    if (grid.layout == FB_ROW_MAJOR) {
+        return grid.view();
     }
-    free(grid);
+
+    if (view_allocated && (view_grid.width != xres || view_grid.height != yres)) {
+        view_grid.release();
+        view_allocated = false;
+    }
+    if (!view_allocated) {
+        view_grid.allocate(xres, yres, FB_ROW_MAJOR);
+        view_allocated = true;
+    }
+    frame_view_t v = view_grid.view();
+    parallelFor(scheduler, 0, yres, PARALLEL_BAND_ROWS, [&](size_t lo, size_t hi) {
+        for (size_t y = lo; y < hi; y++) {
+            grid.readRow(y, (float *) v.row(y));
+        }
+    });
+    return v;
 }
 
 
-void usage(void) {
-    cerr << "Enter input in the form: scene_description_file.txt xres yres\n\t"
-            "xres, yres must be positive integers\n";
-    exit(1);
+void Wireframe::renderBanded(bool antialiase, bool printToStd) {
+    if (ssaa > 1) {
+        throw invalid_argument("Banded rendering doesn't support supersampling.");
+    }
+    Stopwatch watch;
+    bool thick = line_width > 1;
+    double half_width = line_width / 2;
+    /* Rows outside a line's vertexes it can still write to */
+    int reach = thick ? (int) ceil(half_width) : (antialiase ? 1 : 0);
+
+    vector<grid_edge_t> edges;
+    vector<grid_vertex_t> joins;
+    gatherEdges(xres, yres, thick, edges, joins);
+    sortEdges(edges, xres, yres, edge_order);
+    if (!thick) {
+        collapseSubpixelEdges(edges);
+    }
+
+    long long num_bands = ((long long) yres + band_rows - 1) / band_rows;
+    vector<vector<uint32_t>> edge_bins, join_bins;
+    binByBand(edges, joins, band_rows, reach, num_bands, edge_bins, join_bins);
+    stats.addTime("band binning", watch.elapsedMs());
+
+    Framebuffer band;
+    band.allocate(xres, band_rows, FB_ROW_MAJOR);
+    SpanBuffer spans;
+    PpmWriter ppm(file_name + output_suffix + ".ppm", xres, yres, printToStd);
+    ppm.scheduler = scheduler;
+    double raster_ms = 0, output_ms = 0;
+
+    for (long long b = 0; b < num_bands; b++) {
+        Stopwatch band_watch;
+        long long row0 = b * band_rows;
+        int rows = (int) min((long long) band_rows, yres - row0);
+        band.clear();
+
+        /* Draws into the band with rows shifted down by row0 */
+        if (thick) {
+            spans.reset(xres, row0, rows);
+            for (size_t i = 0; i < edge_bins[b].size(); i++) {
+                grid_edge_t &e = edges[edge_bins[b][i]];
+                spans.addSegment(e.a, e.b, half_width);
+            }
+            for (size_t i = 0; i < join_bins[b].size(); i++) {
+                spans.addDisc(joins[join_bins[b][i]], half_width);
+            }
+            spans.resolve([&](int y, int x0, int x1) {
+                for (int x = x0; x < x1; x++) {
+                    band.set(y - row0, x, 1);
+                }
+            });
+        } else {
+            long long row_end = row0 + rows;
+            auto plot_band = [&](long long y, long long x, float shade) {
+                if (y >= row0 && y < row_end && x >= 0 && x < xres) {
+                    band.set(y - row0, x, shade);
+                }
+            };
+            for (size_t i = 0; i < edge_bins[b].size(); i++) {
+                grid_edge_t &e = edges[edge_bins[b][i]];
+                if (isPoint(e)) {
+                    plot_band(e.a.y, e.a.x, 1);
+                } else {
+                    walkLineRows(e.a, e.b, row0 - reach, row_end + reach, antialiase, plot_band);
+                }
+            }
+        }
+        raster_ms += band_watch.elapsedMs();
+
+        Stopwatch output_watch;
+        ppm.writeRows(band, 0, rows);
+        output_ms += output_watch.elapsedMs();
+    }
+    ppm.close();
+    band.release();
+
+    stats.addTime("plot (banded)", raster_ms);
+    stats.addTime("output (banded)", output_ms);
+    if (stats.enabled) {
+        stats.addCount("bands", num_bands);
+        stats.addCount("edges rasterized", edges.size());
+        stats.addCount("band buffer bytes", (long long) band_rows * xres * sizeof(float));
+    }
 }
 
-int main(int argc, char *argv[]) {
-    if (argc != 4) {
-        usage();
+
+/* One of the Pixel Grids renderAnimation draws frames into */
+typedef struct frameBuffer {
+    Framebuffer grid;
+    bool allocated = false;
+} frame_buffer_t;
+
+void Wireframe::renderAnimation(Animation &animation, bool antialiase) {
+    vertex_t scene_pos = cam_pos, scene_orien = cam_orien;
+    double scene_angle = cam_angle;
+    string scene_suffix = output_suffix;
+
+    /* Each frame is plotted into whichever buffer is free while the frame
+       before is written out from the other; plotting waits for one */
+    frame_buffer_t buffers[2];
+    BoundedQueue<frame_buffer_t *> free_buffers(2);
+    free_buffers.push(&buffers[0]);
+    free_buffers.push(&buffers[1]);
+    double output_ms = 0, wait_ms = 0;
+
+    /* Looks each keyed copy up once rather than every frame */
+    vector<pair<const string *, int>> keyed;
+    for (map<string, vector<instance_key_t>>::iterator iter = animation.instance_keys.begin();
+            iter != animation.instance_keys.end(); iter++) {
+        int idx = findInstance(iter->first);
+        if (idx >= 0) {
+            keyed.push_back({&iter->first, idx});
+        }
     }
 
-    try {
-        Wireframe pipeline;
-        pipeline.xres = stoi(argv[2]);
-        pipeline.yres = stoi(argv[3]);
-        if (pipeline.xres <= 0 || pipeline.yres <= 0) {
-            usage();
+    {
+        OrderedStage writer(1);
+        for (int frame = 0; frame < animation.frames; frame++) {
+            cam_pos = scene_pos;
+            cam_orien = scene_orien;
+            cam_angle = scene_angle;
+            animation.cameraAt(frame, cam_pos, cam_orien, cam_angle);
+            for (const pair<const string *, int> &key : keyed) {
+                placeInstance(key.second, animation.instanceAt(*key.first, frame));
+            }
+
+            char suffix[32];
+            snprintf(suffix, sizeof(suffix), "_frame%04d", frame);
+            output_suffix = scene_suffix + suffix;
+
+            computeTransforms();
+            applyTransforms();
+            if (band_rows > 0) {
+                renderBanded(antialiase, false);
+                continue;
+            }
+
+            Stopwatch wait_watch;
+            frame_buffer_t *buffer = nullptr;
+            if (!free_buffers.pop(buffer)) {
+                break;
+            }
+            wait_ms += wait_watch.elapsedMs();
+
+            /* Swapped back even if plot throws, so grid is left as it was */
+            swap(grid, buffer->grid);
+            swap(grid_allocated, buffer->allocated);
+            try {
+                plot(antialiase);
+            } catch (...) {
+                swap(grid, buffer->grid);
+                swap(grid_allocated, buffer->allocated);
+                throw;
+            }
+            swap(grid, buffer->grid);
+            swap(grid_allocated, buffer->allocated);
+
+            string filename = file_name + output_suffix + ".ppm";
+            writer.submit([this, buffer, filename, &free_buffers, &output_ms]() {
+                Stopwatch watch;
+                try {
+                    PpmWriter ppm(filename, xres, yres, false);
+                    ppm.scheduler = scheduler;
+                    ppm.writeRows(buffer->grid, 0, yres);
+                    ppm.close();
+                } catch (...) {
+                    free_buffers.push(buffer);
+                    throw;
+                }
+                output_ms += watch.elapsedMs();
+                free_buffers.push(buffer);
+            });
+        }
+        output_suffix = scene_suffix;
+        writer.finish();
+    }
+
+    for (int i = 0; i < 2; i++) {
+        if (buffers[i].allocated) {
+            buffers[i].grid.release();
         }
-        pipeline.processFormatFile(argv[1]);
-        pipeline.computeTransforms();
-        pipeline.applyTransforms();
-        pipeline.plot(true);
-        pipeline.output(true);
-        pipeline.destruct();
-    } catch (const char *msg) {
-        cerr << msg << endl;
     }
+    if (band_rows == 0) {
+        stats.addTime("output (overlapped)", output_ms);
+        stats.addTime("wait for buffer", wait_ms);
+    }
+    if (stats.enabled) {
+        stats.addCount("frames", animation.frames);
+    }
+}
 
-    return 0;
-}
\ No newline at end of file
+
+void Wireframe::destruct() {
+    if (grid_allocated) {
+        grid.release();
+        grid_allocated = false;
+        grid_wrapped = false;
+    }
+    if (view_allocated) {
+        view_grid.release();
+        view_allocated = false;
+    }
+    depth = DepthBuffer();
+}
@@ -1,9 +1,22 @@
 #ifndef WIREFRAME_H
 #define WIREFRAME_H
 
+#include <iostream>
 #include <map>
+#include <unordered_map>
 #include "object.h"
 #include "transformation.h"
+#include "supersample.h"
+#include "thickline.h"
+#include "edgesort.h"
+#include "stats.h"
+#include "framebuffer.h"
+#include "animation.h"
+#include "meshcache.h"
+#include "scheduler.h"
+#include "depthbuffer.h"
+#include "bvh.h"
+#include "scenefile.h"
 
 using namespace std;
 
@@ -16,13 +29,83 @@ typedef struct perspective {
     double bottom;
 } perspective_t;
 
+/* Faces left out of plotting */
+typedef enum cullMode {
+    /* Every face is drawn */
+    CULL_NONE,
+    /* Faces turned away from the camera are dropped, which for closed 
+       meshes hides their far side */
+    CULL_BACKFACE,
+    /* Lines are only drawn where no face lies in front of them, 
+       tested against a depth buffer of every face */
+    CULL_HIDDEN
+} cull_mode_t;
+
+/* Mesh edges drawn */
+typedef enum edgeMode {
+    /* The edges of every face */
+    EDGES_ALL,
+    /* Only silhouette edges, between a face turned to the camera and one
+       turned away, edges on the border of a mesh, and crease edges whose
+       faces meet at more than crease_angle */
+    EDGES_OUTLINE
+} edge_mode_t;
+
+/* Copy of a read in object placed in the scene, named objectName_copyN */
+typedef struct instance {
+    string name;
+    /* Length of objectName, the start of name, and N */
+    uint32_t object_length;
+    int number;
+    /* Mesh and scene transform the copy is made from, shared by every
+       copy of the mesh until applyTransforms first finds it in view. The
+       transform is read in place from an array the Wireframe keeps alive:
+       a mapped scene file's, or the one its .txt scene was parsed into */
+    shared_ptr<const Object> mesh;
+    const scene_matrix_t *matrix = nullptr;
+    /* Vertexes in scene space, pixels on the Pixel Grid, made by buildCopy
+       at level (0 for the full mesh, i for the mesh's lods[i - 1]), or
+       empty with level -1 if it hasn't been in view */
+    Object copy;
+    int level = -1;
+    /* Extra transform applied before the camera transform if placed;
+       set per frame by renderAnimation through placeInstance */
+    Matrix4d placement;
+    bool placed = false;
+    /* True while its box in copy_bounds awaits the new placement */
+    bool moved = false;
+} instance_t;
+
 class Wireframe {
     public:
         /* File name used to populate Wireframe 
            from processFormatFile with '.txt' removed */
         string file_name;
+        /* Appended to file_name when naming the output PPM */
+        string output_suffix = "";
         /* PPM Resolution */
         int xres, yres;
+        /* Supersampling factor per axis, 1 disables SSAA */
+        int ssaa = 1;
+        /* Filter used to reduce the supersampled image to xres x yres */
+        ssaa_filter_t ssaa_filter = SSAA_BOX;
+        /* Width of rendered lines in output pixels */
+        double line_width = 1;
+        /* Order in which screen-space lines are rasterized */
+        edge_order_t edge_order = EDGE_ORDER_SCENE;
+        /* Faces whose lines are left out */
+        cull_mode_t cull_mode = CULL_NONE;
+        /* Mesh edges whose lines are drawn */
+        edge_mode_t edge_mode = EDGES_ALL;
+        /* Angle in degrees between the normals of two faces above which
+           EDGES_OUTLINE draws the edge they share */
+        double crease_angle = 45;
+        /* Largest error, in output pixels, a copy may be drawn with by
+           using a simplified level of its mesh; 0 always draws the full
+           meshes. Above 0, meshes are simplified as they're read in */
+        double lod_pixels = 0;
+        /* Timings and counters of the last render */
+        RenderStats stats;
         /* Camera parameters */
         vertex_t cam_pos;
         vertex_t cam_orien;
@@ -32,22 +115,83 @@ class Wireframe {
         /* Transformation matrices*/
         Matrix4d cam_space_transform;
         Matrix4d perspec_proj_transform;
-        /* Original read in objects mapped by name*/
-        map<string, Object> objects;
-        /* Copies of the read in objects that are
-           transformed and mapped to a pixel grid */
-        map<string, Object> copies;
+        /* Original read in objects mapped by name, shared read-only
+           with any other Wireframe using the same mesh cache */
+        map<string, shared_ptr<const Object>> objects;
+        /* Cache meshes are loaded through, if set; otherwise each
+           Wireframe parses its own */
+        MeshCache *mesh_cache = nullptr;
+        /* Pool every stage runs its parallel work on, if set; otherwise
+           everything runs on the calling thread. Either gives the same image */
+        Scheduler *scheduler = nullptr;
+        /* Folder the .obj files named by format files are read from */
+        string mesh_dir = "data/";
+        /* Copies of the read in objects that are transformed and mapped
+           to a pixel grid, in order of name, the order lines are drawn in.
+           Per-frame loops walk it by index; names go through findInstance */
+        vector<instance_t> instances;
+        /* Rows per band in banded rendering, 0 renders the whole grid at once */
+        int band_rows = 0;
+        /* Memory layout of the Pixel Grid */
+        fb_layout_t fb_layout = FB_ROW_MAJOR;
         /* Cartesian NDC Pixel Grid 
            Each value [0 to 1] describes how much to shade in the pixel */
-        float** grid;
+        Framebuffer grid;
+        /* Caller-owned row-major storage, rows target_stride floats apart,
+           that plot makes grid draw straight into instead of its own, if
+           set. Needs fb_layout FB_ROW_MAJOR */
+        float *target_pixels = nullptr;
+        size_t target_stride = 0;
 
         /** 
-         * Populates Wireframe properties by reading from format .txt file.
+         * Populates Wireframe properties by reading from format .txt file,
+         * or from a binary scene file if filename ends in '.wfs'.
          * 
-         * @param filename of the .txt file to be processed
+         * @param filename of the .txt or .wfs file to be processed
          * @throws invalid_argument if it fails to read the file
          */ 
         void processFormatFile(string filename);
+
+        /**
+         * Populates Wireframe properties from the contents of a format
+         * .txt file read from file, leaving file_name as is.
+         * .obj paths are resolved against mesh_dir.
+         * 
+         * @throws invalid_argument if it fails to read an .obj file
+         */
+        void processFormat(istream &file);
+
+        /**
+         * Populates Wireframe properties from the binary scene file at
+         * filename (see scenefile.h), leaving file_name as is. The file is
+         * mapped rather than read, and kept mapped while its copies are in
+         * the scene, which read their transforms from it in place.
+         * .obj paths are resolved against mesh_dir.
+         * 
+         * @throws invalid_argument if it fails to read the file or an .obj file
+         */
+        void processSceneFile(const string &filename);
+
+        /**
+         * Writes the scene read in, without any animation, to filename as
+         * a binary scene file that processSceneFile reads back into the
+         * same copies under the same names.
+         * 
+         * @throws invalid_argument if it fails to write the file or an
+         *         object's name or .obj file is too long for it
+         */
+        void saveSceneFile(const string &filename) const;
+
+        /**
+         * Returns the index in instances of the copy named name, or -1.
+         */
+        int findInstance(const string &name) const;
+
+        /**
+         * Forgets the objects and copies of the scene read in so another
+         * can be read in; the Pixel Grid is kept for reuse.
+         */
+        void clearScene();
         
         /**
          * Uses the camera and persepective parameters to compute
@@ -56,14 +200,21 @@ class Wireframe {
         void computeTransforms();
 
         /**
-         * Applies the camera and persepective transformations to each object copy.
+         * Applies the camera and persepective transformations to each object copy
+         * in view, (re)computing its pixels, first making the copy's vertexes if 
+         * it's the first time in view. The vertexes are left untouched so this 
+         * can run again for another camera.
         */
         void applyTransforms();
 
         /**
          * Plots the tranformed object copies to the pixed grid.
          * 
-         * This allocates data for grid, the only malloced attribute.
+         * This allocates data for grid, the only malloced attribute, or
+         * clears and reuses it if an earlier call allocated the same size.
+         * If ssaa > 1, lines are rasterized at ssaa times the resolution
+         * and filtered down, in which case antialiase is ignored. 
+         * Lines wider than 1 pixel are drawn solid as spans.
         */
         void plot(bool antialiase);
 
@@ -77,11 +228,156 @@ class Wireframe {
         void output(bool printToStd);
 
         /**
-         * Destructs the object by freeing any allocated data (grid)
+         * Writes the output image as a PPM to out, as output does to a file.
+        */
+        void encode(ostream &out);
+
+        /**
+         * Returns a read-only view of the image computed by plot. An 
+         * FB_ROW_MAJOR grid is viewed in place with nothing copied or 
+         * encoded; other layouts are first gathered into a row-major copy.
+         * The view stays valid until the next plot, view or destruct.
+         * 
+         * @throws logic_error if plot hasn't run
+        */
+        frame_view_t view();
+
+        /**
+         * Plots and writes the image band_rows rows at a time instead of
+         * calling plot and output, for images too large for a full grid.
+         * 
+         * Lines are binned by the bands they reach, then each band is drawn
+         * into one reusable band_rows by xres buffer and written out before
+         * the next, so memory doesn't grow with yres. Gives the same image
+         * as plot followed by output. Doesn't support supersampling.
+         * 
+         * @throws invalid_argument if ssaa > 1
+         * @throws runtime_error if it fails to open the file
+        */
+        void renderBanded(bool antialiase, bool printToStd);
+
+        /**
+         * Renders every frame of animation, writing each to 
+         * file_name + "_frameNNNN.ppm". The scene is parsed once; each frame
+         * only moves the camera and copies, then reruns computeTransforms, 
+         * applyTransforms and plot against the same buffers.
+         * 
+         * Frames are written out by a stage of their own, overlapping the
+         * next frame's transform and plot: plot alternates between two
+         * Pixel Grids, waiting for the older frame's write to finish before
+         * reusing its grid. Frames are not printed to standard out.
+        */
+        void renderAnimation(Animation &animation, bool antialiase);
+
+        /**
+         * Destructs the object by freeing any allocated data (grid and
+         * any copy of it made by view)
         */
         void destruct();
 
     private:
+        /* True once plot has allocated grid */
+        bool grid_allocated = false;
+        /* True while grid wraps target_pixels rather than owning storage */
+        bool grid_wrapped = false;
+        /* Row-major copy of a tiled grid handed out by view */
+        Framebuffer view_grid;
+        bool view_allocated = false;
+
+        /* Index in instances of each copy by name, for reading the scene
+           in and setting up animations */
+        unordered_map<string, uint32_t> instance_names;
+        /* Copies made so far of each object, numbering the next one */
+        unordered_map<string, int> copy_counts;
+        /* .obj file of each object as named by its scene, for saveSceneFile */
+        map<string, string> mesh_files;
+        /* Arrays the instances' matrices point into: mapped SceneFiles and
+           the vectors .txt scenes were parsed into, shared by any copy of
+           the Wireframe */
+        vector<shared_ptr<const void>> matrix_arrays;
+
+        /* Hierarchy over copy_bounds, the box around each instance's
+           bounding sphere in the order of instances. Boxes are worked out
+           when the tree is built and then only redone for moved_copies,
+           the instances placeInstance has moved since */
+        InstanceBvh copy_bvh;
+        bool bvh_built = false;
+        vector<box_t> copy_bounds;
+        vector<uint32_t> moved_copies;
+        /* Indexes, in order, of the instances the last applyTransforms
+           found in view; the stages after it only visit these */
+        vector<uint32_t> visible_copies;
+
+        /* Nearest face depths of the last CULL_HIDDEN plot */
+        DepthBuffer depth;
+
+        /* Cache models fed by plotPoint while stats.model_cache is set */
+        CacheModel *l1_model = nullptr;
+        CacheModel *l2_model = nullptr;
+
+        /**
+         * Loads the meshes, given as object names and .obj files under
+         * mesh_dir, in parallel, adding them to objects in order.
+         */
+        void loadMeshes(const vector<pair<string, string>> &meshes);
+
+        /**
+         * Adds an instance of objectName under the next unique name, placed
+         * in the scene by matrix, which must outlive it, returning its
+         * index. Its copy is left to buildCopy.
+         */
+        uint32_t addInstance(const string &objectName, const scene_matrix_t *matrix);
+
+        /**
+         * Sorts the instances, new ones included, back into order of name.
+         */
+        void sortInstances();
+
+        /**
+         * Makes inst's copy from the given level of its mesh, unless it's
+         * already at that level.
+         */
+        void buildCopy(instance_t &inst, int level);
+
+        /**
+         * Maps the vertexes of copy to the Pixel Grid through copy_transform,
+         * saving them as its pixels.
+        */
+        void mapToGrid(Object &copy, const Matrix4d &copy_transform);
+
+        /**
+         * Sets the placement of instance idx, marking its box for refit.
+        */
+        void placeInstance(uint32_t idx, const Matrix4d &placement);
+
+        /**
+         * Returns the box around inst's bounding sphere after its
+         * placement, if placed.
+        */
+        box_t copyBounds(const instance_t &inst) const;
+
+        /**
+         * Returns the indexes, in order, of the instances whose bounding
+         * sphere may reach the Pixel Grid. ndc_transform takes world space
+         * to clip space. Builds copy_bvh for a new scene, refits it to the
+         * moved instances if there are any, then queries it, so a frame
+         * takes time in the copies moved and in view, not in the scene.
+        */
+        vector<uint32_t> cullCopies(const Matrix4d &ndc_transform);
+
+        /**
+         * Returns the coarsest level of detail of inst's mesh whose error,
+         * seen from the camera, stays within lod_pixels. view takes the
+         * copy's vertexes to camera space.
+        */
+        int selectLod(const instance_t &inst, const Matrix4d &view) const;
+
+        /**
+         * Returns the scheduler to plot into grid with, or nullptr if
+         * grid's layout can't be written by several threads at once.
+        */
+        Scheduler *rasterScheduler();
+
         /**
          * Returns if the point (y,x) lies within the Pixel Grid.
          * @param y, the y component of the point (y, x)
@@ -108,6 +404,68 @@ class Wireframe {
          * @param antialiase, if true, antialiases rendered line (extra credit)
          */ 
         void bresenhamRasterize(grid_vertex_t v1, grid_vertex_t v2, bool antialiase);
+
+        /**
+         * Collects the lines of every face whose vertexes both lie on a 
+         * grid_xres by grid_yres Pixel Grid, skipping faces cull_mode 
+         * drops, so lines only bordering dropped faces are left out.
+         * With EDGES_OUTLINE only the outline edges of each copy are kept.
+         * 
+         * @param unique, if true, lines shared by several faces are kept once
+         *                and the vertexes they meet at are saved to joins
+        */
+        void gatherEdges(int grid_xres, int grid_yres, bool unique,
+                         vector<grid_edge_t> &edges, vector<grid_vertex_t> &joins);
+
+        /**
+         * Turns the edges of one-pixel lines into single points and drops
+         * repeated points with collapseEdges, so the one pixel wide
+         * rasterizers plot them directly without any line setup. Counts
+         * both in stats.
+        */
+        void collapseSubpixelEdges(vector<grid_edge_t> &edges);
+
+        /**
+         * Rasterizes every face in front of the camera into depth, then
+         * replaces edges by their runs that no face hides and drops the
+         * hidden joins. edge_depths holds the depths of the two ends of 
+         * each edge, join_depths the depth of each join.
+         * 
+         * Faces are drawn a band of rows per task and edges clipped a 
+         * chunk per task on scheduler; edges keep their order.
+        */
+        void removeHiddenLines(int grid_xres, int grid_yres,
+                               vector<grid_edge_t> &edges, const vector<float> &edge_depths,
+                               vector<grid_vertex_t> &joins, const vector<float> &join_depths);
+
+        /**
+         * Draws every line one pixel wide with bresenhamRasterize,
+         * in the order given by edge_order.
+        */
+        void plotLines(bool antialiase);
+
+        /**
+         * Draws every line line_width pixels wide with round joins by
+         * filling merged spans per scanline, so each pixel is written once.
+        */
+        void plotThick();
+
+        /**
+         * Draws edges and joins as plotLines (thick false) or plotThick
+         * would, with a task per band of rows on scheduler.
+        */
+        void plotBands(const vector<grid_edge_t> &edges, 
+                       const vector<grid_vertex_t> &joins, bool thick, bool antialiase);
+
+        /**
+         * Rasterizes every line into a coverage buffer ssaa times the 
+         * resolution of the Pixel Grid, then filters it down into grid.
+         * 
+         * Works one strip of output rows at a time with the lines binned by
+         * the strips they touch, so the full supersampled image is never 
+         * held in memory.
+        */
+        void plotSupersampled();
 };
 
 #endif
\ No newline at end of file